@@ -0,0 +1,318 @@
+#include "group_hash_map.h"
+#include "hash_map.h"
+
+#include <benchmark/benchmark.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+#include <random>
+#include <string>
+#include <sys/resource.h>
+#include <unordered_map>
+#include <vector>
+
+/// Benchmarks of HashMap against std::unordered_map and GroupHashMap, the open-addressing baseline. Every workload runs
+/// for integer and string keys and for sizes from L1-resident to far beyond the last level cache, lookups draw the keys
+/// uniformly or by the Zipf law. Besides the time, the benchmarks report:
+///     time_per_op        seconds per operation, printed like 12.3n for nanoseconds, also for the workloads that do a
+///                        whole pass per iteration;
+///     bytes_per_element  heap growth of the built map per element, the keys included;
+///     peak_bytes         highest heap usage during the build, it shows the transient cost of rehashes;
+///     peak_rss_mb        peak resident set of the process, it only grows, so run one benchmark per process with
+///                        --benchmark_filter for the exact number of a single map.
+///
+/// Build: cmake -S benchmarks -B build && cmake --build build && build/hash_map_benchmark
+
+/// Heap usage counted by the replaced operators new and delete, so that all maps are measured alike. The benchmarks are
+/// single-threaded, so the counters are plain.
+static size_t live_bytes = 0;
+static size_t peak_bytes = 0;
+
+static void *CountAllocation(void *pointer) {
+    if (pointer == nullptr) {
+        throw std::bad_alloc();
+    }
+    live_bytes += malloc_usable_size(pointer);
+    peak_bytes = std::max(peak_bytes, live_bytes);
+    return pointer;
+}
+
+static void CountDeallocation(void *pointer) {
+    if (pointer != nullptr) {
+        live_bytes -= malloc_usable_size(pointer);
+        free(pointer);
+    }
+}
+
+void *operator new(size_t size) {
+    return CountAllocation(malloc(size == 0 ? 1 : size));
+}
+
+void *operator new(size_t size, std::align_val_t alignment) {
+    void *pointer = nullptr;
+    if (posix_memalign(&pointer, std::max(static_cast<size_t>(alignment), sizeof(void *)), size == 0 ? 1 : size) != 0) {
+        pointer = nullptr;
+    }
+    return CountAllocation(pointer);
+}
+
+void operator delete(void *pointer) noexcept {
+    CountDeallocation(pointer);
+}
+
+void operator delete(void *pointer, size_t) noexcept {
+    CountDeallocation(pointer);
+}
+
+void operator delete(void *pointer, std::align_val_t) noexcept {
+    CountDeallocation(pointer);
+}
+
+void operator delete(void *pointer, size_t, std::align_val_t) noexcept {
+    CountDeallocation(pointer);
+}
+
+/// Maps under the test.
+template <class Key>
+using StdMap = std::unordered_map<Key, uint64_t>;
+template <class Key>
+using ListMap = HashMap<Key, uint64_t>;
+template <class Key>
+using DenseMap = HashMap<Key, uint64_t, std::hash<Key>, std::equal_to<Key>, DenseStorage>;
+template <class Key>
+using GroupMap = GroupHashMap<Key, uint64_t, std::hash<Key>, std::equal_to<Key>, DenseStorage>;
+
+/// Sizes from 256 elements, that fit L1 with any map, to 4M, whose tables are far beyond the last level cache.
+static constexpr int64_t MIN_SIZE = 1 << 8;
+static constexpr int64_t MAX_SIZE = 1 << 22;
+/// Number of precomputed lookup keys, the sequence wraps around.
+static constexpr size_t QUERY_COUNT = 1 << 20;
+/// Exponent of the Zipf law.
+static constexpr double ZIPF_EXPONENT = 0.99;
+
+enum class Distribution { UNIFORM, ZIPF };
+
+/// Finalizer of SplitMix64, a bijection, so keys of distinct indices are distinct.
+static uint64_t Mix(uint64_t x) {
+    x = (x ^ (x >> 30ull)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27ull)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31ull);
+}
+
+/// Returns the key of the index. Indices from size on give the keys that are never inserted.
+template <class Key>
+static Key MakeKey(uint64_t index);
+
+template <>
+uint64_t MakeKey<uint64_t>(uint64_t index) {
+    return Mix(index);
+}
+
+/// Strings of 12 characters, they fit the small string buffer, so the heap usage is that of the map.
+template <>
+std::string MakeKey<std::string>(uint64_t index) {
+    static constexpr char DIGITS[] = "abcdefghijklmnopqrstuvwxyz012345";
+    uint64_t bits = Mix(index);
+    std::string key(12, ' ');
+    for (char &c : key) {
+        c = DIGITS[bits & 31ull];
+        bits >>= 5ull;
+    }
+    return key;
+}
+
+template <class Key>
+static std::vector<Key> MakeKeys(size_t first, size_t count) {
+    std::vector<Key> keys;
+    keys.reserve(count);
+    for (size_t i = first; i < first + count; ++i) {
+        keys.push_back(MakeKey<Key>(i));
+    }
+    return keys;
+}
+
+/// Returns QUERY_COUNT indices less than size. Ranks of the Zipf law are assigned to the indices in a random order, so
+/// the hot keys are scattered over the table.
+static std::vector<size_t> MakeQueries(size_t size, Distribution distribution) {
+    std::mt19937_64 random(size);
+    std::vector<size_t> queries(QUERY_COUNT);
+    if (distribution == Distribution::UNIFORM) {
+        for (auto &query : queries) {
+            query = random() % size;
+        }
+        return queries;
+    }
+    std::vector<double> cdf(size);
+    double sum = 0;
+    for (size_t rank = 0; rank < size; ++rank) {
+        sum += 1 / std::pow(static_cast<double>(rank + 1), ZIPF_EXPONENT);
+        cdf[rank] = sum;
+    }
+    std::vector<size_t> index_of_rank(size);
+    for (size_t i = 0; i < size; ++i) {
+        index_of_rank[i] = i;
+    }
+    std::shuffle(index_of_rank.begin(), index_of_rank.end(), random);
+    std::uniform_real_distribution<double> uniform(0, sum);
+    for (auto &query : queries) {
+        size_t rank = std::lower_bound(cdf.begin(), cdf.end(), uniform(random)) - cdf.begin();
+        query = index_of_rank[std::min(rank, size - 1)];
+    }
+    return queries;
+}
+
+/// Inserts the keys, each mapped to its index.
+template <class Map, class Key>
+static void Fill(Map &map, const std::vector<Key> &keys) {
+    for (size_t i = 0; i < keys.size(); ++i) {
+        map.insert({keys[i], i});
+    }
+}
+
+static void ReportMemory(benchmark::State &state, size_t bytes, size_t peak, size_t size) {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    state.counters["bytes_per_element"] = static_cast<double>(bytes) / static_cast<double>(size);
+    state.counters["peak_bytes"] = static_cast<double>(peak);
+    state.counters["peak_rss_mb"] = static_cast<double>(usage.ru_maxrss) / 1024;
+}
+
+/// Reports the time of one operation, when an iteration does ops_per_iteration of them.
+static void ReportOps(benchmark::State &state, size_t ops_per_iteration) {
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * ops_per_iteration));
+    state.counters["time_per_op"] =
+        benchmark::Counter(static_cast<double>(ops_per_iteration),
+                           benchmark::Counter::kIsIterationInvariantRate | benchmark::Counter::kInvert);
+}
+
+/// Measures the memory of the map built from the keys without timing it.
+template <class Map, class Key>
+static void MeasureBuild(benchmark::State &state, const std::vector<Key> &keys) {
+    size_t before = live_bytes;
+    peak_bytes = live_bytes;
+    Map map;
+    Fill(map, keys);
+    ReportMemory(state, live_bytes - before, peak_bytes - before, keys.size());
+}
+
+/// Inserts all keys into an empty map, the growth included.
+template <class Map, class Key>
+static void BenchInsert(benchmark::State &state) {
+    auto keys = MakeKeys<Key>(0, state.range(0));
+    for (auto _ : state) {
+        Map map;
+        Fill(map, keys);
+        benchmark::DoNotOptimize(map.size());
+        state.PauseTiming();
+        {
+            Map destroyed(std::move(map));
+        }
+        state.ResumeTiming();
+    }
+    ReportOps(state, keys.size());
+    MeasureBuild<Map>(state, keys);
+}
+
+/// Looks up present keys drawn by the distribution.
+template <class Map, class Key, Distribution D>
+static void BenchFindHit(benchmark::State &state) {
+    auto keys = MakeKeys<Key>(0, state.range(0));
+    auto queries = MakeQueries(keys.size(), D);
+    Map map;
+    Fill(map, keys);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(map.find(keys[queries[i++ & (QUERY_COUNT - 1)]])->second);
+    }
+    ReportOps(state, 1);
+    MeasureBuild<Map>(state, keys);
+}
+
+/// Looks up keys that are not in the map.
+template <class Map, class Key>
+static void BenchFindMiss(benchmark::State &state) {
+    auto keys = MakeKeys<Key>(0, state.range(0));
+    auto misses = MakeKeys<Key>(keys.size(), std::min<size_t>(keys.size(), QUERY_COUNT));
+    Map map;
+    Fill(map, keys);
+    size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(map.find(misses[i++ % misses.size()]) == map.end());
+    }
+    ReportOps(state, 1);
+    MeasureBuild<Map>(state, keys);
+}
+
+/// Erases all keys in a random order from the full map, the build is not timed.
+template <class Map, class Key>
+static void BenchErase(benchmark::State &state) {
+    auto keys = MakeKeys<Key>(0, state.range(0));
+    auto order = keys;
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(keys.size()));
+    for (auto _ : state) {
+        state.PauseTiming();
+        Map map;
+        Fill(map, keys);
+        state.ResumeTiming();
+        for (const auto &key : order) {
+            map.erase(key);
+        }
+        benchmark::DoNotOptimize(map.size());
+    }
+    ReportOps(state, keys.size());
+    MeasureBuild<Map>(state, keys);
+}
+
+/// Visits all elements.
+template <class Map, class Key>
+static void BenchIterate(benchmark::State &state) {
+    auto keys = MakeKeys<Key>(0, state.range(0));
+    Map map;
+    Fill(map, keys);
+    for (auto _ : state) {
+        uint64_t sum = 0;
+        for (const auto &x : map) {
+            sum += x.second;
+        }
+        benchmark::DoNotOptimize(sum);
+    }
+    ReportOps(state, keys.size());
+    MeasureBuild<Map>(state, keys);
+}
+
+/// Registers every workload of the map with the key type. Names are workload/map/key[/distribution]/size.
+template <template <class> class Map, class Key>
+static void RegisterMap(const std::string &map_name, const std::string &key_name) {
+    auto add = [](const std::string &name, void (*function)(benchmark::State &)) {
+        benchmark::RegisterBenchmark(name.c_str(), function)->RangeMultiplier(8)->Range(MIN_SIZE, MAX_SIZE);
+    };
+    std::string suffix = "/" + map_name + "/" + key_name;
+    add("insert" + suffix, BenchInsert<Map<Key>, Key>);
+    add("find_hit" + suffix + "/uniform", BenchFindHit<Map<Key>, Key, Distribution::UNIFORM>);
+    add("find_hit" + suffix + "/zipf", BenchFindHit<Map<Key>, Key, Distribution::ZIPF>);
+    add("find_miss" + suffix, BenchFindMiss<Map<Key>, Key>);
+    add("erase" + suffix, BenchErase<Map<Key>, Key>);
+    add("iterate" + suffix, BenchIterate<Map<Key>, Key>);
+}
+
+template <template <class> class Map>
+static void RegisterMap(const std::string &map_name) {
+    RegisterMap<Map, uint64_t>(map_name, "uint64");
+    RegisterMap<Map, std::string>(map_name, "string");
+}
+
+int main(int argc, char **argv) {
+    RegisterMap<StdMap>("std_unordered_map");
+    RegisterMap<ListMap>("hash_map_list");
+    RegisterMap<DenseMap>("hash_map_dense");
+    RegisterMap<GroupMap>("group_hash_map");
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,392 @@
+#pragma once
+
+#include "hash_map.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <exception>
+#include <fcntl.h>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+/// Parser of the records ended by '\n' for BulkLoader. Parse(std::string_view) returns std::pair<Key, T> of a line
+/// without the newline, a trailing '\r' of the line is left to it. Empty lines are skipped, the last line of the input
+/// may lack the newline.
+template <class Parse>
+class LineParser {
+public:
+    explicit LineParser(Parse parse = Parse()) : parse_(std::move(parse)) {
+    }
+
+    /// Returns the length of the complete records at the beginning of the data.
+    size_t Boundary(const char *data, size_t size) const {
+        const void *last = memrchr(data, '\n', size);
+        return last == nullptr ? 0 : static_cast<size_t>(static_cast<const char *>(last) - data) + 1;
+    }
+
+    /// Appends the elements of the records in the data to the batch.
+    template <class Batch>
+    void operator()(const char *data, size_t size, Batch &batch) const {
+        const char *end = data + size;
+        while (data != end) {
+            const auto *newline = static_cast<const char *>(memchr(data, '\n', static_cast<size_t>(end - data)));
+            const char *line_end = newline == nullptr ? end : newline;
+            if (line_end != data) {
+                batch.push_back(parse_(std::string_view(data, static_cast<size_t>(line_end - data))));
+            }
+            data = newline == nullptr ? end : newline + 1;
+        }
+    }
+
+private:
+    Parse parse_;
+};
+
+/// Parser of the fixed-size records for BulkLoader: the bytes of Key are followed by the bytes of T, both trivially
+/// copyable and in the byte order of the machine, without padding.
+template <class Key, class T>
+struct BinaryRecordParser {
+    static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<T>,
+                  "binary records need trivially copyable keys and values");
+
+    static constexpr size_t RECORD_SIZE = sizeof(Key) + sizeof(T);
+
+    /// Returns the length of the complete records at the beginning of the data.
+    size_t Boundary(const char *, size_t size) const {
+        return size - size % RECORD_SIZE;
+    }
+
+    /// Appends the elements of the records in the data to the batch. Throws std::runtime_error, if the last record is
+    /// truncated.
+    template <class Batch>
+    void operator()(const char *data, size_t size, Batch &batch) const {
+        if (size % RECORD_SIZE != 0) {
+            throw std::runtime_error("BinaryRecordParser: truncated record");
+        }
+        for (const char *end = data + size; data != end; data += RECORD_SIZE) {
+            Key key;
+            T value;
+            memcpy(&key, data, sizeof(Key));
+            memcpy(&value, data + sizeof(Key), sizeof(T));
+            batch.emplace_back(key, value);
+        }
+    }
+};
+
+/// Bulk loader fills a HashMap from a file by a pipeline of three stages, that overlap. A reader thread reads chunks
+/// by large sequential reads and cuts them at the boundaries of the records, worker threads parse the chunks and hash
+/// the keys, and the calling thread inserts the parsed batches in the order of the file by insert_batch with the
+/// hashes, so of the equal keys the first one is kept as by insert. The table is reserved once for the number of the
+/// records estimated by the first batch and the size of the file, so the map doesn't grow step by step. At most
+/// max_chunks() chunks are read but not inserted, so the memory is bounded however large the file is.
+///
+/// Parser has Boundary(const char *data, size_t size), that returns the length of the complete records at the
+/// beginning of the data, and operator()(const char *data, size_t size, Batch &batch), that appends the elements of
+/// the records to std::vector<std::pair<Key, T>>, as LineParser and BinaryRecordParser do. The last chunk of the file
+/// is passed to the parser whole, with a record, that may lack its end. Parser and Hash are called concurrently.
+template <class Map, class Parser>
+class BulkLoader {
+public:
+    /// Public typedefs:
+
+    using KeyType = typename Map::KeyType;
+    using MappedType = typename Map::MappedType;
+    using SizeType = size_t;
+    using Batch = std::vector<std::pair<KeyType, MappedType>>;
+
+    explicit BulkLoader(Parser parser = Parser()) : parser_(std::move(parser)) {
+    }
+
+    /// Returns the number of bytes read at once.
+    SizeType chunk_size() const {
+        return chunk_size_;
+    }
+
+    /// Sets the number of bytes read at once. A record longer than a chunk is read by several reads.
+    void chunk_size(SizeType size) {
+        chunk_size_ = std::max<SizeType>(size, 1);
+    }
+
+    /// Returns the maximum number of chunks in the pipeline.
+    SizeType max_chunks() const {
+        return max_chunks_;
+    }
+
+    /// Sets the maximum number of chunks in the pipeline, read, parsed or being inserted. The reader waits, while
+    /// there are so many.
+    void max_chunks(SizeType count) {
+        max_chunks_ = std::max<SizeType>(count, 1);
+    }
+
+    /// Returns the number of the parsing threads.
+    SizeType threads() const {
+        return threads_;
+    }
+
+    /// Sets the number of the parsing threads. Zero means one per hardware thread besides the reader and the caller.
+    void threads(SizeType threads) {
+        threads_ = threads;
+    }
+
+    /// Loads the file into the map. Returns the number of the inserted elements. Throws std::runtime_error, if the
+    /// file can't be read, and passes the exceptions of the parser and of the map on. The elements inserted before an
+    /// exception stay in the map.
+    SizeType load(Map &map, const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("BulkLoader: can't open " + path);
+        }
+        try {
+            SizeType inserted = load(map, fd);
+            close(fd);
+            return inserted;
+        } catch (...) {
+            close(fd);
+            throw;
+        }
+    }
+
+    /// Loads the file descriptor from its offset to the end into the map, as the other load does. The descriptor
+    /// stays open.
+    SizeType load(Map &map, int fd) {
+        Pipeline pipeline(*this, map, fd);
+        return pipeline.Run();
+    }
+
+private:
+    /// Chunk of the file, its records and their hashes.
+    struct Chunk {
+        SizeType index = 0;
+        std::vector<char> data;
+        Batch batch;
+        std::vector<SizeType> hashes;
+    };
+
+    /// State of one load. Chunks go from the reader through the queue to the workers and then into parsed_ by their
+    /// index, from which the caller takes them in order and returns them to free_.
+    class Pipeline {
+    public:
+        Pipeline(const BulkLoader &loader, Map &map, int fd) : loader_(loader), map_(map), fd_(fd) {
+#ifdef POSIX_FADV_SEQUENTIAL
+            posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+            struct stat status {};
+            off_t offset = lseek(fd_, 0, SEEK_CUR);
+            if (fstat(fd_, &status) == 0 && S_ISREG(status.st_mode) && offset >= 0 && status.st_size > offset) {
+                file_size_ = static_cast<SizeType>(status.st_size - offset);
+            }
+        }
+
+        SizeType Run() {
+            SizeType workers = loader_.threads_;
+            if (workers == 0) {
+                workers = std::max<SizeType>(std::thread::hardware_concurrency(), 3) - 2;
+            }
+            std::vector<std::thread> threads;
+            SizeType inserted = 0;
+            try {
+                threads.emplace_back([this] { Guard([this] { Read(); }); });
+                for (SizeType i = 0; i < workers; ++i) {
+                    threads.emplace_back([this] { Guard([this] { Parse(); }); });
+                }
+                inserted = Insert();
+            } catch (...) {
+                Fail(std::current_exception());
+            }
+            for (auto &thread : threads) {
+                thread.join();
+            }
+            if (error_) {
+                std::rethrow_exception(error_);
+            }
+            return inserted;
+        }
+
+    private:
+        /// Calls f and stops the pipeline, if it throws.
+        template <class F>
+        void Guard(F f) {
+            try {
+                f();
+            } catch (...) {
+                Fail(std::current_exception());
+            }
+        }
+
+        void Fail(std::exception_ptr error) {
+            std::lock_guard lock(mutex_);
+            if (!error_) {
+                error_ = error;
+            }
+            changed_.notify_all();
+        }
+
+        /// Reader stage: reads the chunks and cuts them after the last complete record, the rest begins the next one.
+        void Read() {
+            std::vector<char> rest;
+            bool end = false;
+            for (SizeType index = 0; !end; ++index) {
+                Chunk *chunk = TakeFree();
+                if (chunk == nullptr) {
+                    return;
+                }
+                chunk->index = index;
+                chunk->data.swap(rest);
+                SizeType boundary = 0;
+                while (!end && boundary == 0) {
+                    SizeType size = chunk->data.size();
+                    chunk->data.resize(size + loader_.chunk_size_);
+                    SizeType count = ReadFully(chunk->data.data() + size, loader_.chunk_size_);
+                    chunk->data.resize(size + count);
+                    end = count < loader_.chunk_size_;
+                    boundary = end ? chunk->data.size() : loader_.parser_.Boundary(chunk->data.data(), size + count);
+                }
+                rest.assign(chunk->data.begin() + static_cast<std::ptrdiff_t>(boundary), chunk->data.end());
+                chunk->data.resize(boundary);
+                std::lock_guard lock(mutex_);
+                if (end) {
+                    chunk_count_ = chunk->data.empty() ? index : index + 1;
+                }
+                if (chunk->data.empty()) {
+                    free_.push_back(chunk);
+                } else {
+                    read_.push_back(chunk);
+                }
+                changed_.notify_all();
+            }
+        }
+
+        /// Reads up to size bytes, less only at the end of the file.
+        SizeType ReadFully(char *buffer, SizeType size) {
+            SizeType done = 0;
+            while (done < size) {
+                ssize_t count = read(fd_, buffer + done, size - done);
+                if (count < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (count < 0) {
+                    throw std::runtime_error("BulkLoader: read failed");
+                }
+                if (count == 0) {
+                    break;
+                }
+                done += static_cast<SizeType>(count);
+            }
+            return done;
+        }
+
+        /// Returns a chunk for the reader, waiting while max_chunks are in the pipeline, or nullptr, if it has failed.
+        Chunk *TakeFree() {
+            std::unique_lock lock(mutex_);
+            changed_.wait(lock, [this] { return error_ || !free_.empty() || chunks_.size() < loader_.max_chunks_; });
+            if (error_) {
+                return nullptr;
+            }
+            if (free_.empty()) {
+                chunks_.push_back(std::make_unique<Chunk>());
+                return chunks_.back().get();
+            }
+            Chunk *chunk = free_.back();
+            free_.pop_back();
+            return chunk;
+        }
+
+        /// Parsing stage: parses the chunks and hashes their keys, until the reader ends and the queue is empty.
+        void Parse() {
+            auto hasher = map_.hash_function();
+            while (true) {
+                Chunk *chunk = nullptr;
+                {
+                    std::unique_lock lock(mutex_);
+                    changed_.wait(lock, [this] { return error_ || !read_.empty() || chunk_count_ != NONE; });
+                    if (error_ || read_.empty()) {
+                        return;
+                    }
+                    chunk = read_.front();
+                    read_.pop_front();
+                }
+                chunk->batch.clear();
+                loader_.parser_(chunk->data.data(), chunk->data.size(), chunk->batch);
+                chunk->hashes.resize(chunk->batch.size());
+                for (SizeType i = 0; i < chunk->batch.size(); ++i) {
+                    chunk->hashes[i] = hasher(chunk->batch[i].first);
+                }
+                std::lock_guard lock(mutex_);
+                parsed_.emplace(chunk->index, chunk);
+                changed_.notify_all();
+            }
+        }
+
+        /// Inserting stage: inserts the parsed chunks in the order of the file. Returns the number of the inserted
+        /// elements.
+        SizeType Insert() {
+            SizeType old_size = map_.size();
+            for (SizeType index = 0;; ++index) {
+                Chunk *chunk = nullptr;
+                {
+                    std::unique_lock lock(mutex_);
+                    changed_.wait(lock, [&] {
+                        return error_ || parsed_.count(index) != 0 || (chunk_count_ != NONE && index >= chunk_count_);
+                    });
+                    if (error_ || parsed_.count(index) == 0) {
+                        break;
+                    }
+                    chunk = parsed_.at(index);
+                    parsed_.erase(index);
+                }
+                if (index == 0 && file_size_ != 0) {
+                    /// Records of the first chunk tell the number of the records in the whole file.
+                    map_.reserve(map_.size() + static_cast<SizeType>(static_cast<double>(chunk->batch.size()) *
+                                                                     static_cast<double>(file_size_) /
+                                                                     static_cast<double>(chunk->data.size())));
+                }
+                map_.insert_batch(std::make_move_iterator(chunk->batch.begin()),
+                                  std::make_move_iterator(chunk->batch.end()), chunk->hashes.begin());
+                std::lock_guard lock(mutex_);
+                free_.push_back(chunk);
+                changed_.notify_all();
+            }
+            return map_.size() - old_size;
+        }
+
+        static constexpr SizeType NONE = -1;
+
+        const BulkLoader &loader_;
+        Map &map_;
+        int fd_;
+        /// Bytes from the offset to the end of a regular file or zero.
+        SizeType file_size_ = 0;
+
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        /// All chunks of the load.
+        std::vector<std::unique_ptr<Chunk>> chunks_;
+        std::vector<Chunk *> free_;
+        std::deque<Chunk *> read_;
+        std::map<SizeType, Chunk *> parsed_;
+        /// Number of the chunks, it is known when the reader ends.
+        SizeType chunk_count_ = NONE;
+        std::exception_ptr error_;
+    };
+
+    static constexpr SizeType CHUNK_SIZE = 4ull << 20ull;
+    static constexpr SizeType MAX_CHUNKS = 16;
+
+    /// Private fields:
+
+    Parser parser_;
+    SizeType chunk_size_ = CHUNK_SIZE;
+    SizeType max_chunks_ = MAX_CHUNKS;
+    SizeType threads_ = 0;
+};
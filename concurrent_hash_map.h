@@ -0,0 +1,250 @@
+#pragma once
+
+#include "hash_map.h"
+
+#include <mutex>
+#include <shared_mutex>
+#include <thread>
+
+/// Concurrent hash map is a thread-safe associative container built on shards, each of them is a HashMap guarded by
+/// its own reader-writer lock. A key goes to the shard chosen by the high bits of its mixed hash, so that operations
+/// on different shards don't contend. Since elements may be erased by other threads at any time, no iterators or
+/// references are given out: values are copied out, and callbacks see the elements under the lock of their shard.
+/// The template parameters are passed to HashMap of the shards.
+template <class Key, class T, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>,
+          class Storage = ListStorage, class GrowPolicy = PrimeGrowPolicy, class HashCache = NoHashCache,
+          class SlotIndex = size_t, class Allocator = std::allocator<std::pair<const Key, T>>, class Stats = NoStats>
+class ConcurrentHashMap {
+public:
+    /// Public typedefs:
+
+    using Map = HashMap<Key, T, Hash, Equal, Storage, GrowPolicy, HashCache, SlotIndex, Allocator, Stats>;
+    using KeyType = Key;
+    using MappedType = T;
+    using ValueType = std::pair<const Key, T>;
+    using SizeType = size_t;
+    using Hasher = Hash;
+    using KeyEqual = Equal;
+
+    /// Creates an empty map with shard_count shards rounded up to a power of two. Zero means four shards per hardware
+    /// thread.
+    explicit ConcurrentHashMap(SizeType shard_count = 0, const Hasher &hf = Hasher(), const KeyEqual &eq = KeyEqual())
+        : hasher_(hf) {
+        if (shard_count == 0) {
+            shard_count = std::max<SizeType>(std::thread::hardware_concurrency(), 1) << 2ull;
+        }
+        while ((1ull << shard_bits_) < shard_count) {
+            ++shard_bits_;
+        }
+        shards_ = std::vector<Shard>(1ull << shard_bits_);
+        for (auto &shard : shards_) {
+            shard.map = Map(hf, eq);
+        }
+    }
+
+    ConcurrentHashMap(const ConcurrentHashMap &) = delete;
+    ConcurrentHashMap &operator=(const ConcurrentHashMap &) = delete;
+
+    /// Returns the number of elements. Under concurrent modifications it is a snapshot of every shard at some moment.
+    SizeType size() const {
+        SizeType size = 0;
+        for (const auto &shard : shards_) {
+            std::shared_lock lock(shard.mutex);
+            size += shard.map.size();
+        }
+        return size;
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Returns the number of shards.
+    SizeType shard_count() const {
+        return shards_.size();
+    }
+
+    /// Clears the contents.
+    void clear() {
+        for (auto &shard : shards_) {
+            std::unique_lock lock(shard.mutex);
+            shard.map.clear();
+        }
+    }
+
+    /// Makes every shard large enough for its part of n elements.
+    void reserve(SizeType n) {
+        for (auto &shard : shards_) {
+            std::unique_lock lock(shard.mutex);
+            shard.map.reserve((n >> shard_bits_) + 1);
+        }
+    }
+
+    /// Inserts the element, if there is no element with its key. Returns whether the insertion took place.
+    bool insert(const ValueType &x) {
+        Shard &shard = GetShard(x.first);
+        std::unique_lock lock(shard.mutex);
+        return shard.map.insert(x).second;
+    }
+
+    /// Inserts the element, if there is no element with its key. Returns whether the insertion took place.
+    bool insert(ValueType &&x) {
+        Shard &shard = GetShard(x.first);
+        std::unique_lock lock(shard.mutex);
+        return shard.map.insert(std::move(x)).second;
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with the key. Returns
+    /// whether the insertion took place.
+    template <class... Args>
+    bool try_emplace(const KeyType &key, Args &&...args) {
+        Shard &shard = GetShard(key);
+        std::unique_lock lock(shard.mutex);
+        return shard.map.try_emplace(key, std::forward<Args>(args)...).second;
+    }
+
+    /// Assigns obj to the mapped value of the key or inserts it, if there is no element with the key. Returns whether
+    /// the insertion took place.
+    template <class M>
+    bool insert_or_assign(const KeyType &key, M &&obj) {
+        Shard &shard = GetShard(key);
+        std::unique_lock lock(shard.mutex);
+        auto [it, inserted] = shard.map.try_emplace(key, std::forward<M>(obj));
+        if (!inserted) {
+            it->second = std::forward<M>(obj);
+        }
+        return inserted;
+    }
+
+    /// Erases the element with the key. Returns whether it existed.
+    bool erase(const KeyType &key) {
+        Shard &shard = GetShard(key);
+        std::unique_lock lock(shard.mutex);
+        if (shard.map.find(key) == shard.map.end()) {
+            return false;
+        }
+        shard.map.erase(key);
+        return true;
+    }
+
+    /// Erases every element, for which pred(const ValueType &) returns true. Shards are processed one by one, each
+    /// under its lock. Returns the number of erased elements.
+    template <class Predicate>
+    SizeType erase_if(Predicate pred) {
+        SizeType erased = 0;
+        std::vector<KeyType> keys;
+        for (auto &shard : shards_) {
+            std::unique_lock lock(shard.mutex);
+            /// Erasure may move elements of the storage, so the keys are collected first.
+            for (const auto &x : shard.map) {
+                if (pred(x)) {
+                    keys.push_back(x.first);
+                }
+            }
+            for (const auto &key : keys) {
+                shard.map.erase(key);
+            }
+            erased += keys.size();
+            keys.clear();
+        }
+        return erased;
+    }
+
+    /// Copies the mapped value of the key to value. Returns whether the key exists.
+    bool find(const KeyType &key, MappedType &value) const {
+        return visit(key, [&value](const ValueType &x) { value = x.second; });
+    }
+
+    /// Checks whether the key exists.
+    bool contains(const KeyType &key) const {
+        const Shard &shard = GetShard(key);
+        std::shared_lock lock(shard.mutex);
+        return shard.map.find(key) != shard.map.end();
+    }
+
+    /// Calls f(const ValueType &) for the element with the key under the shared lock. Returns whether the key exists.
+    template <class F>
+    bool visit(const KeyType &key, F f) const {
+        const Shard &shard = GetShard(key);
+        std::shared_lock lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        f(*it);
+        return true;
+    }
+
+    /// Calls f(MappedType &) for the element with the key under the exclusive lock, so the update is atomic. Returns
+    /// whether the key exists.
+    template <class F>
+    bool update_fn(const KeyType &key, F f) {
+        Shard &shard = GetShard(key);
+        std::unique_lock lock(shard.mutex);
+        auto it = shard.map.find(key);
+        if (it == shard.map.end()) {
+            return false;
+        }
+        f(it->second);
+        return true;
+    }
+
+    /// Calls f(MappedType &) for the element with the key under the exclusive lock, inserting the value-initialized
+    /// element first, if there is no element with the key. Returns the result of f.
+    template <class F>
+    auto compute(const KeyType &key, F f) {
+        Shard &shard = GetShard(key);
+        std::unique_lock lock(shard.mutex);
+        return f(shard.map[key]);
+    }
+
+    /// Calls f(const ValueType &) for every element. Shards are visited one by one, each under the shared lock.
+    template <class F>
+    void for_each(F f) const {
+        for (const auto &shard : shards_) {
+            std::shared_lock lock(shard.mutex);
+            for (const auto &x : shard.map) {
+                f(x);
+            }
+        }
+    }
+
+    /// Returns function used to hash the keys.
+    Hasher hash_function() const {
+        return hasher_;
+    }
+
+private:
+    /// Shards are aligned to the cache line, so that locks of neighbouring shards don't share it.
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        Map map;
+    };
+
+    /// Returns the shard of the key. The hash is mixed and its high bits are taken, since HashMap of the shard uses the
+    /// low ones.
+    Shard &GetShard(const KeyType &key) {
+        return shards_[ShardIndex(key)];
+    }
+
+    const Shard &GetShard(const KeyType &key) const {
+        return shards_[ShardIndex(key)];
+    }
+
+    SizeType ShardIndex(const KeyType &key) const {
+        if (shard_bits_ == 0) {
+            return 0;
+        }
+        return (static_cast<uint64_t>(hasher_(key)) * 0x9E3779B97F4A7C15ull) >> (64ull - shard_bits_);
+    }
+
+    /// Private fields:
+
+    /// Shards of the map.
+    std::vector<Shard> shards_;
+    /// Number of shards is (1 << shard_bits_).
+    SizeType shard_bits_ = 0;
+    /// Function used to hash the keys.
+    Hasher hasher_;
+};
@@ -0,0 +1,202 @@
+#pragma once
+
+#include "hash_map.h"
+
+#include <array>
+#include <string_view>
+
+/// Hasher, that can be evaluated at compile time: integers and enums hash to themselves like std::hash, strings by
+/// FNV-1a. It is transparent, so a map with std::string_view keys is searched by std::string or const char * as is.
+struct ConstexprHash {
+    using is_transparent = void;  // NOLINT
+
+    template <class K, class = std::enable_if_t<std::is_integral_v<K> || std::is_enum_v<K>>>
+    constexpr size_t operator()(K key) const {
+        return static_cast<size_t>(key);
+    }
+
+    constexpr size_t operator()(std::string_view key) const {
+        uint64_t hash = 0xCBF29CE484222325ull;
+        for (char c : key) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+        }
+        return static_cast<size_t>(hash);
+    }
+};
+
+/// Constexpr hash map is an immutable map of N elements, whose table is built at compile time, when the map is a
+/// constexpr variable. The table is coalesced with the cellar as in HashMap, sized by the grow policy for the load
+/// factor 0.5. The elements and the slots are arrays inside the object, so the map allocates nothing, is initialized
+/// as a constant and keeps no static initialization order problems. Hash and Equal must be usable in constant
+/// expressions for that, the defaults are ConstexprHash and std::equal_to<>. Maps are created by
+/// make_constexpr_hash_map.
+template <class Key, class T, size_t N, class Hash = ConstexprHash, class Equal = std::equal_to<>,
+          class GrowPolicy = PrimeGrowPolicy>
+class ConstexprHashMap {
+    /// Enables lookups by the compatible key K, if both Hash and Equal are transparent.
+    template <class K>
+    using EnableIfTransparent =
+        std::enable_if_t<IsTransparent<Hash>::value && IsTransparent<Equal>::value && std::is_same_v<K, K>>;
+
+public:
+    /// Public typedefs:
+
+    using KeyType = Key;
+    using MappedType = T;
+    using ValueType = std::pair<const Key, T>;
+    using SizeType = size_t;
+    using Hasher = Hash;
+    using KeyEqual = Equal;
+
+    /// Elements lie in the array in the order of the list, so pointers are the iterators.
+
+    using iterator = const ValueType *;        // NOLINT
+    using const_iterator = const ValueType *;  // NOLINT
+
+    /// Creates the map from the list of the elements with unique keys. A duplicate key throws std::invalid_argument,
+    /// that is a compilation error in a constant expression.
+    constexpr explicit ConstexprHashMap(const std::pair<Key, T> (&items)[N], const Hasher &hf = Hasher(),
+                                        const KeyEqual &eq = KeyEqual())
+        : ConstexprHashMap(items, hf, eq, std::make_index_sequence<N>()) {
+    }
+
+    /// Returns the number of elements.
+    constexpr SizeType size() const {
+        return N;
+    }
+
+    /// Checks whether the container is empty.
+    constexpr bool empty() const {
+        return N == 0;
+    }
+
+    /// Returns the mapped value of the element with a key equal to the given one. Throws std::out_of_range, if there
+    /// is no such element.
+    constexpr const MappedType &at(const KeyType &key) const {
+        return At(key);
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    constexpr const MappedType &at(const K &key) const {
+        return At(key);
+    }
+
+    /// Finds the element with a key equal to the given one.
+    constexpr const_iterator find(const KeyType &key) const {
+        return begin() + Find(key);
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    constexpr const_iterator find(const K &key) const {
+        return begin() + Find(key);
+    }
+
+    /// Checks whether there is an element with a key equal to the given one.
+    constexpr bool contains(const KeyType &key) const {
+        return Find(key) != N;
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    constexpr bool contains(const K &key) const {
+        return Find(key) != N;
+    }
+
+    constexpr const_iterator begin() const {
+        return elements_.data();
+    }
+
+    constexpr const_iterator end() const {
+        return elements_.data() + N;
+    }
+
+    /// Returns function used to hash the keys.
+    constexpr Hasher hash_function() const {
+        return hasher_;
+    }
+
+    /// Returns function used to compare the keys for equality.
+    constexpr KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+private:
+    /// Slot of the table, value is the index of its element or NONE.
+    struct Slot {
+        SizeType value = NONE;
+        SizeType next = NONE;
+    };
+
+    /// Copies the elements and links them into the table. Elements are inserted in the order of the list, a collided
+    /// one takes the last empty slot, the cellar first, as Place of HashMap does.
+    template <size_t... Indices>
+    constexpr ConstexprHashMap(const std::pair<Key, T> (&items)[N], const Hasher &hf, const KeyEqual &eq,
+                               std::index_sequence<Indices...>)
+        : elements_{{ValueType(items[Indices])...}}, hasher_(hf), key_equal_(eq) {
+        SizeType free = TABLE_SIZE;
+        for (SizeType i = 0; i < N; ++i) {
+            if (Find(elements_[i].first) != N) {
+                throw std::invalid_argument("ConstexprHashMap: duplicate key");
+            }
+            SizeType pos = GrowPolicy::Index(hasher_(elements_[i].first), PRIMARY_SIZE);
+            if (slots_[pos].value != NONE) {
+                while (slots_[pos].next != NONE) {
+                    pos = slots_[pos].next;
+                }
+                do {
+                    --free;
+                } while (slots_[free].value != NONE);
+                slots_[pos].next = free;
+                pos = free;
+            }
+            slots_[pos].value = i;
+        }
+    }
+
+    /// Returns index of the element with the key or N, if there is none.
+    template <class K>
+    constexpr SizeType Find(const K &key) const {
+        SizeType pos = GrowPolicy::Index(hasher_(key), PRIMARY_SIZE);
+        while (pos != NONE && slots_[pos].value != NONE) {
+            if (key_equal_(elements_[slots_[pos].value].first, key)) {
+                return slots_[pos].value;
+            }
+            pos = slots_[pos].next;
+        }
+        return N;
+    }
+
+    template <class K>
+    constexpr const MappedType &At(const K &key) const {
+        SizeType index = Find(key);
+        if (index == N) {
+            throw std::out_of_range("_Map_base::at");
+        }
+        return elements_[index].second;
+    }
+
+    /// NONE is means there is no element or no link.
+    static constexpr SizeType NONE = -1;
+    /// Size of the addressable part for the load factor 0.5 and of the table with the cellar of HashMap.
+    static constexpr SizeType PRIMARY_SIZE = GrowPolicy::NextSize(N << 1ull);
+    static constexpr SizeType TABLE_SIZE = PRIMARY_SIZE + (PRIMARY_SIZE * 7 + 42) / 43;
+
+    /// Private fields:
+
+    /// Elements in the order of the list.
+    std::array<ValueType, N> elements_;
+    /// Slots of the table.
+    std::array<Slot, TABLE_SIZE> slots_{};
+    /// Function used to hash the keys.
+    Hasher hasher_;
+    /// Function used to compare the keys for equality.
+    KeyEqual key_equal_;
+};
+
+/// Creates the constexpr hash map from the list of the elements, deducing its size:
+///     constexpr auto OPCODES = make_constexpr_hash_map<std::string_view, int>({{"add", 1}, {"sub", 2}});
+template <class Key, class T, class Hash = ConstexprHash, class Equal = std::equal_to<>,
+          class GrowPolicy = PrimeGrowPolicy, size_t N>
+constexpr ConstexprHashMap<Key, T, N, Hash, Equal, GrowPolicy> make_constexpr_hash_map(
+    const std::pair<Key, T> (&items)[N]) {
+    return ConstexprHashMap<Key, T, N, Hash, Equal, GrowPolicy>(items);
+}
@@ -0,0 +1,281 @@
+#pragma once
+
+#include "hash_map.h"
+
+#include <fcntl.h>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/// Frozen hash map is a read-only view of the snapshot written by HashMap::write_snapshot. The file is mapped into
+/// memory and lookups walk the chains of the mapped slots, so opening costs no deserialization and the pages are shared
+/// by all processes that map the file. Opening reads the slots once to check that they refer into the file, so a
+/// corrupted snapshot can't make lookups read outside of it or loop, but the keys and values are served unchecked.
+/// GrowPolicy and SlotIndex must be those of the written map, they are checked by
+/// the header as well as the sizes of the types and the seed of the hasher, so a seeded hasher is passed with the seed
+/// of the written map, e.g. SeededHash(map.hash_function().seed()).
+template <class Key, class T, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>,
+          class GrowPolicy = PrimeGrowPolicy, class SlotIndex = size_t>
+class FrozenHashMap {
+    /// Enables lookups by the compatible key K, if both Hash and Equal are transparent.
+    template <class K>
+    using EnableIfTransparent =
+        std::enable_if_t<IsTransparent<Hash>::value && IsTransparent<Equal>::value && std::is_same_v<K, K>>;
+
+public:
+    /// Public typedefs:
+
+    using KeyType = Key;
+    using MappedType = T;
+    using ValueType = std::pair<const Key, T>;
+    using SizeType = size_t;
+    using Hasher = Hash;
+    using KeyEqual = Equal;
+
+    /// Elements lie in the mapped file one after another, so pointers are the iterators.
+
+    using iterator = const ValueType *;        // NOLINT
+    using const_iterator = const ValueType *;  // NOLINT
+
+    /// Maps the snapshot file. Throws std::runtime_error, if the file can't be mapped or doesn't match the map type.
+    explicit FrozenHashMap(const std::string &path, const Hasher &hf = Hasher(), const KeyEqual &eq = KeyEqual())
+        : hasher_(hf), key_equal_(eq) {
+        Map(path);
+    }
+
+    FrozenHashMap(const FrozenHashMap &) = delete;
+    FrozenHashMap &operator=(const FrozenHashMap &) = delete;
+
+    /// Move constructor. The other map is left without a file.
+    FrozenHashMap(FrozenHashMap &&other) : hasher_(other.hasher_), key_equal_(other.key_equal_) {
+        swap(other);
+    }
+
+    /// Move assignment operator. The file of this map is unmapped.
+    FrozenHashMap &operator=(FrozenHashMap &&other) {
+        if (this != &other) {
+            FrozenHashMap moved(std::move(other));
+            swap(moved);
+        }
+        return *this;
+    }
+
+    ~FrozenHashMap() {
+        if (address_ != nullptr) {
+            munmap(address_, mapped_size_);
+        }
+    }
+
+    /// Exchanges the contents with the other map.
+    void swap(FrozenHashMap &other) {
+        std::swap(address_, other.address_);
+        std::swap(mapped_size_, other.mapped_size_);
+        std::swap(slots_, other.slots_);
+        std::swap(values_, other.values_);
+        std::swap(element_count_, other.element_count_);
+        std::swap(primary_size_, other.primary_size_);
+        std::swap(table_size_, other.table_size_);
+        std::swap(hasher_, other.hasher_);
+        std::swap(key_equal_, other.key_equal_);
+    }
+
+    /// Returns the number of elements.
+    SizeType size() const {
+        return element_count_;
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Returns the mapped value of the element with a key equal to the given one. Throws std::out_of_range, if there
+    /// is no such element.
+    const MappedType &at(const KeyType &key) const {
+        return At(key);
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    const MappedType &at(const K &key) const {
+        return At(key);
+    }
+
+    /// Finds the element with a key equal to the given one.
+    const_iterator find(const KeyType &key) const {
+        return Find(key);
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    const_iterator find(const K &key) const {
+        return Find(key);
+    }
+
+    /// Checks whether there is an element with a key equal to the given one.
+    bool contains(const KeyType &key) const {
+        return Find(key) != end();
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    bool contains(const K &key) const {
+        return Find(key) != end();
+    }
+
+    const_iterator begin() const {
+        return values_;
+    }
+
+    const_iterator end() const {
+        return values_ + element_count_;
+    }
+
+    /// Returns function used to hash the keys.
+    Hasher hash_function() const {
+        return hasher_;
+    }
+
+    /// Returns function used to compare the keys for equality.
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+private:
+    using FileSlot = SnapshotFormat::Slot<SlotIndex>;
+
+    /// Maps the file and checks that its header describes a snapshot of this map type.
+    void Map(const std::string &path) {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            throw std::runtime_error("FrozenHashMap: can't open " + path);
+        }
+        struct stat status {};
+        if (fstat(fd, &status) != 0 || static_cast<uint64_t>(status.st_size) < sizeof(SnapshotFormat::Header)) {
+            close(fd);
+            throw std::runtime_error("FrozenHashMap: " + path + " is not a snapshot");
+        }
+        mapped_size_ = static_cast<SizeType>(status.st_size);
+        void *address = mmap(nullptr, mapped_size_, PROT_READ, MAP_SHARED, fd, 0);
+        /// The mapping stays valid after the descriptor is closed.
+        close(fd);
+        if (address == MAP_FAILED) {
+            throw std::runtime_error("FrozenHashMap: can't map " + path);
+        }
+        address_ = address;
+
+        const auto &header = *static_cast<const SnapshotFormat::Header *>(address_);
+        const char *base = static_cast<const char *>(address_);
+        const char *error = CheckHeader(header);
+        if (error == nullptr) {
+            error = CheckSlots(reinterpret_cast<const FileSlot *>(base + header.slots_offset), header);
+        }
+        if (error != nullptr) {
+            munmap(address_, mapped_size_);
+            address_ = nullptr;
+            throw std::runtime_error("FrozenHashMap: " + path + ": " + error);
+        }
+        /// Lookups touch random pages, so after the sequential check the read-ahead would only waste the page cache.
+        madvise(address_, mapped_size_, MADV_RANDOM);
+        slots_ = reinterpret_cast<const FileSlot *>(base + header.slots_offset);
+        values_ = reinterpret_cast<const ValueType *>(base + header.values_offset);
+        element_count_ = header.element_count;
+        primary_size_ = header.primary_size;
+        table_size_ = header.table_size;
+    }
+
+    /// Returns the description of the mismatch or nullptr, if the snapshot can be served.
+    const char *CheckHeader(const SnapshotFormat::Header &header) const {
+        if (header.magic != SnapshotFormat::MAGIC) {
+            return "bad magic number";
+        }
+        if (header.version != SnapshotFormat::VERSION) {
+            return "unsupported version";
+        }
+        if (header.grow_policy != GrowPolicy::ID || header.slot_index_size != sizeof(SlotIndex)) {
+            return "other grow policy or slot index";
+        }
+        if (header.key_size != sizeof(Key) || header.mapped_size != sizeof(T) ||
+            header.value_size != sizeof(ValueType)) {
+            return "other key or value type";
+        }
+        if (header.hash_seed != HashSeed<Hasher>::Get(hasher_)) {
+            return "other hash seed";
+        }
+        /// The regions are checked by division, so that the sizes from the file can't overflow the offsets.
+        if (header.primary_size == 0 || header.primary_size > header.table_size ||
+            header.element_count > header.table_size || header.file_size > mapped_size_ ||
+            header.slots_offset % SnapshotFormat::ALIGNMENT != 0 ||
+            header.values_offset % SnapshotFormat::ALIGNMENT != 0 || header.slots_offset > header.values_offset ||
+            header.values_offset > header.file_size ||
+            header.table_size > (header.values_offset - header.slots_offset) / sizeof(FileSlot) ||
+            header.element_count > (header.file_size - header.values_offset) / sizeof(ValueType)) {
+            return "truncated or corrupted";
+        }
+        return nullptr;
+    }
+
+    /// Returns the description of the corruption or nullptr, if every slot refers to an element and to a next slot of
+    /// the snapshot.
+    const char *CheckSlots(const FileSlot *slots, const SnapshotFormat::Header &header) const {
+        for (SizeType pos = 0; pos < header.table_size; ++pos) {
+            const FileSlot &slot = slots[pos];
+            if ((slot.rev_pos < FileSlot::DELETED && slot.rev_pos >= header.element_count) ||
+                (slot.next != FileSlot::NO_NEXT && slot.next >= header.table_size)) {
+                return "corrupted slots";
+            }
+        }
+        return nullptr;
+    }
+
+    /// Walks the chain of the key's home slot in the same way HashMap does. The map without a file has no elements. A
+    /// chain visits every slot at most once, so the walk is bounded by the table size against a cycle in the file.
+    template <class K>
+    const_iterator Find(const K &key) const {
+        if (element_count_ == 0) {
+            return end();
+        }
+        SizeType pos = GrowPolicy::Index(hasher_(key), primary_size_);
+        for (SizeType step = 0; step < table_size_; ++step) {
+            const FileSlot &slot = slots_[pos];
+            if (slot.rev_pos < FileSlot::DELETED) {
+                if (key_equal_(values_[slot.rev_pos].first, key)) {
+                    return values_ + slot.rev_pos;
+                }
+            } else if (slot.rev_pos == FileSlot::EMPTY) {
+                return end();
+            }
+            if (slot.next == FileSlot::NO_NEXT) {
+                return end();
+            }
+            pos = slot.next;
+        }
+        return end();
+    }
+
+    template <class K>
+    const MappedType &At(const K &key) const {
+        auto it = Find(key);
+        if (it == end()) {
+            throw std::out_of_range("_Map_base::at");
+        }
+        return it->second;
+    }
+
+    /// Private fields:
+
+    /// Beginning and size of the mapping, the address is nullptr, if there is none.
+    void *address_ = nullptr;
+    SizeType mapped_size_ = 0;
+    /// Slots of the table and the elements in the mapped file.
+    const FileSlot *slots_ = nullptr;
+    const ValueType *values_ = nullptr;
+    /// Number of elements.
+    SizeType element_count_ = 0;
+    /// Size of the addressable part.
+    SizeType primary_size_ = 1;
+    /// Size of the whole table.
+    SizeType table_size_ = 0;
+    /// Function used to hash the keys.
+    Hasher hasher_;
+    /// Function used to compare the keys for equality.
+    KeyEqual key_equal_;
+};
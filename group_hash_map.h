@@ -0,0 +1,710 @@
+#pragma once
+
+#include "hash_map.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+/// Group of control bytes of the group probing table, that is matched at once. Control byte of a used slot is a 7-bit
+/// fragment of its hash, empty and deleted slots have the highest bit set. The widest available instruction set is
+/// used: AVX2 matches 32 slots, SSE2 and NEON match 16, otherwise the bytes are compared one by one.
+class ControlGroup {
+public:
+#if defined(__AVX2__)
+    static constexpr size_t WIDTH = 32;
+#else
+    static constexpr size_t WIDTH = 16;
+#endif
+
+    /// Control bytes of empty and deleted slots.
+    static constexpr int8_t EMPTY = -128;
+    static constexpr int8_t DELETED = -2;
+
+    /// Loads WIDTH control bytes starting from ctrl.
+    explicit ControlGroup(const int8_t *ctrl) {
+#if defined(__AVX2__)
+        ctrl_ = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(ctrl));
+#elif defined(__SSE2__)
+        ctrl_ = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        ctrl_ = vld1q_s8(ctrl);
+#else
+        std::copy(ctrl, ctrl + WIDTH, ctrl_);
+#endif
+    }
+
+    /// Returns the mask of slots with the control byte equal to the fragment of the hash.
+    uint32_t Match(int8_t fragment) const {
+#if defined(__AVX2__)
+        return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_set1_epi8(fragment), ctrl_)));
+#elif defined(__SSE2__)
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(fragment), ctrl_)));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        return ToMask(vceqq_s8(vdupq_n_s8(fragment), ctrl_));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < WIDTH; ++i) {
+            mask |= static_cast<uint32_t>(ctrl_[i] == fragment) << i;
+        }
+        return mask;
+#endif
+    }
+
+    /// Returns the mask of empty slots.
+    uint32_t MatchEmpty() const {
+        return Match(EMPTY);
+    }
+
+    /// Returns the mask of empty and deleted slots.
+    uint32_t MatchFree() const {
+#if defined(__AVX2__)
+        return static_cast<uint32_t>(_mm256_movemask_epi8(ctrl_));
+#elif defined(__SSE2__)
+        return static_cast<uint32_t>(_mm_movemask_epi8(ctrl_));
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+        return ToMask(vcltzq_s8(ctrl_));
+#else
+        uint32_t mask = 0;
+        for (size_t i = 0; i < WIDTH; ++i) {
+            mask |= static_cast<uint32_t>(ctrl_[i] < 0) << i;
+        }
+        return mask;
+#endif
+    }
+
+    /// Returns the index of the lowest slot in the non-zero mask.
+    static size_t LowestSlot(uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+        return static_cast<size_t>(__builtin_ctz(mask));
+#else
+        size_t index = 0;
+        for (; (mask & 1u) == 0; mask >>= 1u) {
+            ++index;
+        }
+        return index;
+#endif
+    }
+
+private:
+#if defined(__ARM_NEON) && defined(__aarch64__)
+    /// NEON has no movemask, so every lane keeps its own bit and the halves are summed up.
+    static uint32_t ToMask(uint8x16_t matched) {
+        static const uint8_t BITS[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+        uint8x16_t bits = vandq_u8(matched, vld1q_u8(BITS));
+        return vaddv_u8(vget_low_u8(bits)) | (static_cast<uint32_t>(vaddv_u8(vget_high_u8(bits))) << 8u);
+    }
+#endif
+
+#if defined(__AVX2__)
+    __m256i ctrl_;
+#elif defined(__SSE2__)
+    __m128i ctrl_;
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    int8x16_t ctrl_;
+#else
+    int8_t ctrl_[WIDTH];
+#endif
+};
+
+/// Group hash map is an alternative backend of HashMap with its core interface, so call sites, that use only it,
+/// switch between them by the type alias. The interface is narrower than that of HashMap: there is no Allocator or
+/// Stats parameter, and no find_batch, contains_batch, insert_batch, insert_bulk, stats(), write_snapshot or
+/// move_to_back. Collisions are resolved by the open addressing over groups of slots: the table keeps a control byte
+/// per slot, and lookups match the hash fragment against the whole ControlGroup in one SIMD instruction, while probe
+/// steps don't depend on loads from the previous slots. Storage and SlotIndex have the same meaning as for HashMap,
+/// the cellar, grow and hash cache policies and the incremental rehash have no counterparts here.
+template <class Key, class T, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>,
+          class Storage = ListStorage, class SlotIndex = size_t>
+class GroupHashMap {
+    /// Enables lookups by the compatible key K, if both Hash and Equal are transparent. The condition is made dependent
+    /// on K, so that the overloads are discarded by substitution failure.
+    template <class K>
+    using EnableIfTransparent =
+        std::enable_if_t<IsTransparent<Hash>::value && IsTransparent<Equal>::value && std::is_same_v<K, K>>;
+
+public:
+    /// Public typedefs:
+
+    using KeyType = Key;
+    using MappedType = T;
+    using ValueType = std::pair<const Key, T>;
+    using SizeType = size_t;
+    using Hasher = Hash;
+    using KeyEqual = Equal;
+
+    /// Since values are contained in the storage, its iterators are used. Iterator-related typedefs:
+
+    using iterator = typename Storage::template Container<ValueType>::iterator;              // NOLINT
+    using const_iterator = typename Storage::template Container<ValueType>::const_iterator;  // NOLINT
+
+    /// Default constructor creates no elements.
+    explicit GroupHashMap(const Hasher &hf = Hasher(), const KeyEqual &eq = KeyEqual()) : hasher_(hf), key_equal_(eq) {
+        Rehash(0);
+    }
+
+    /// Create an hash map consisting of copies of the elements from [first, last).
+    template <typename InputIterator>
+    GroupHashMap(InputIterator first, InputIterator last, const Hasher &hf = Hasher(), const KeyEqual &eq = KeyEqual())
+        : GroupHashMap(hf, eq) {
+        using Category = typename std::iterator_traits<InputIterator>::iterator_category;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+            reserve(static_cast<SizeType>(std::distance(first, last)));
+        }
+        for (auto it = first; it != last; ++it) {
+            emplace(*it);
+        }
+    }
+
+    /// Create an hash map consisting of copies of the elements in the list.
+    GroupHashMap(std::initializer_list<std::pair<KeyType, MappedType>> list, const Hasher &hf = Hasher(),
+                 const KeyEqual &eq = KeyEqual())
+        : GroupHashMap(hf, eq) {
+        reserve(list.size());
+        for (const auto &x : list) {
+            emplace(x);
+        }
+    }
+
+    /// Copy constructor. The table is copied as it is, and the elements once, so no key is hashed. Links of the slots
+    /// are moved to the copied elements by the storage, as HashMap does in Clone.
+    GroupHashMap(const GroupHashMap &other)
+        : positions_(other.positions_),
+          ctrl_(other.ctrl_),
+          slots_(other.slots_),
+          group_mask_(other.group_mask_),
+          growth_left_(other.growth_left_),
+          deleted_count_(other.deleted_count_),
+          max_load_factor_(other.max_load_factor_),
+          hasher_(other.hasher_),
+          key_equal_(other.key_equal_) {
+        values_.CopyFrom(other.values_, [this](SizeType i) -> Link & { return slots_[positions_[i]]; });
+    }
+
+    /// Move constructor. The table and the elements are taken from the other hash map, which is left empty without
+    /// a table, so nothing is allocated. Its table is allocated by the first insertion.
+    GroupHashMap(GroupHashMap &&other) noexcept(std::is_nothrow_copy_constructible_v<Hasher> &&
+                                                std::is_nothrow_copy_constructible_v<KeyEqual>)
+        : values_(std::move(other.values_)),
+          positions_(std::move(other.positions_)),
+          ctrl_(std::move(other.ctrl_)),
+          slots_(std::move(other.slots_)),
+          group_mask_(other.group_mask_),
+          growth_left_(other.growth_left_),
+          deleted_count_(other.deleted_count_),
+          max_load_factor_(other.max_load_factor_),
+          hasher_(other.hasher_),
+          key_equal_(other.key_equal_) {
+        other.values_.clear();
+        other.positions_.clear();
+        other.ctrl_.clear();
+        other.slots_.clear();
+        other.group_mask_ = 0;
+        other.growth_left_ = 0;
+        other.deleted_count_ = 0;
+    }
+
+    /// Copy assignment operator.
+    GroupHashMap &operator=(const GroupHashMap &other) {
+        if (this != &other) {
+            GroupHashMap copy(other);
+            swap(copy);
+        }
+        return *this;
+    }
+
+    /// Move assignment operator. The other hash map is left empty.
+    GroupHashMap &operator=(GroupHashMap &&other) {
+        if (this != &other) {
+            GroupHashMap moved(std::move(other));
+            swap(moved);
+        }
+        return *this;
+    }
+
+    /// Exchanges the contents with the other hash map.
+    void swap(GroupHashMap &other) {
+        std::swap(values_, other.values_);
+        positions_.swap(other.positions_);
+        ctrl_.swap(other.ctrl_);
+        slots_.swap(other.slots_);
+        std::swap(group_mask_, other.group_mask_);
+        std::swap(growth_left_, other.growth_left_);
+        std::swap(deleted_count_, other.deleted_count_);
+        std::swap(max_load_factor_, other.max_load_factor_);
+        std::swap(hasher_, other.hasher_);
+        std::swap(key_equal_, other.key_equal_);
+    }
+
+    /// Returns the number of elements.
+    SizeType size() const {
+        return positions_.size();
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Clears the contents.
+    void clear() {
+        values_.clear();
+        positions_.clear();
+        std::fill(ctrl_.begin(), ctrl_.end(), ControlGroup::EMPTY);
+        deleted_count_ = 0;
+        growth_left_ = MaxElementCount(ctrl_.size());
+    }
+
+    /// Rebuilds the table without growing it, so that no deleted slots are left.
+    void compact() {
+        Rehash(ctrl_.size());
+    }
+
+    /// Rebuilds the table so that it has at least n slots and the load factor doesn't exceed the maximum one. The
+    /// table may shrink.
+    void rehash(SizeType n) {
+        Rehash(std::max(n, MinCapacity(size())));
+    }
+
+    /// Makes the table large enough to contain n elements without growing.
+    void reserve(SizeType n) {
+        if (n > MaxElementCount(ctrl_.size())) {
+            Rehash(MinCapacity(n));
+        }
+    }
+
+    /// Shrinks the table and the storage of elements to the current number of elements.
+    void shrink_to_fit() {
+        rehash(0);
+        values_.ShrinkToFit();
+        positions_.shrink_to_fit();
+    }
+
+    /// Returns the number of elements per slot.
+    float load_factor() const {
+        return ctrl_.empty() ? 0 : static_cast<float>(size()) / ctrl_.size();
+    }
+
+    /// Returns the load factor, after which the table grows.
+    float max_load_factor() const {
+        return max_load_factor_;
+    }
+
+    /// Sets the load factor in (0, 1], after which the table grows. The table is rebuilt, if it is loaded more. At
+    /// least one slot is always left empty, so that probes terminate.
+    void max_load_factor(float ml) {
+        if (!(ml > 0 && ml <= 1)) {
+            throw std::invalid_argument("GroupHashMap::max_load_factor");
+        }
+        max_load_factor_ = ml;
+        if (size() + deleted_count_ > MaxElementCount(ctrl_.size())) {
+            rehash(0);
+        } else {
+            growth_left_ = MaxElementCount(ctrl_.size()) - size() - deleted_count_;
+        }
+    }
+
+    /// Inserts elements. Returns iterator to the element with the key and whether the insertion took place.
+    std::pair<iterator, bool> insert(const ValueType &x) {
+        return try_emplace(x.first, x.second);
+    }
+
+    /// Inserts elements. Returns iterator to the element with the key and whether the insertion took place.
+    std::pair<iterator, bool> insert(ValueType &&x) {
+        SizeType hash = hasher_(x.first);
+        SizeType pos = Find(x.first, hash);
+        if (pos != NONE) {
+            return {GetIterator(pos), false};
+        }
+        values_.EmplaceBack(std::move(x));
+        return {GetIterator(Insert(hash)), true};
+    }
+
+    /// Constructs the element from args and inserts it, if there is no element with its key. Returns iterator to the
+    /// element with the key and whether the insertion took place.
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args &&...args) {
+        /// The key is known only after the construction, so the element is constructed at the end of values_ and is
+        /// removed, if the key exists.
+        values_.EmplaceBack(std::forward<Args>(args)...);
+        SizeType hash, pos;
+        try {
+            const KeyType &key = values_.Back().first;
+            hash = hasher_(key);
+            pos = Find(key, hash);
+        } catch (...) {
+            values_.PopBack();
+            throw;
+        }
+        if (pos != NONE) {
+            values_.PopBack();
+            return {GetIterator(pos), false};
+        }
+        return {GetIterator(Insert(hash)), true};
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with the key. Otherwise
+    /// nothing is constructed. Returns iterator to the element with the key and whether the insertion took place.
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType &key, Args &&...args) {
+        return TryEmplace(key, std::forward<Args>(args)...);
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with the key. Otherwise
+    /// nothing is constructed. Returns iterator to the element with the key and whether the insertion took place.
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType &&key, Args &&...args) {
+        return TryEmplace(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with an equal key.
+    /// Key is constructed from the compatible key only when the insertion takes place.
+    template <class K, class... Args, class = EnableIfTransparent<K>>
+    std::pair<iterator, bool> try_emplace(K &&key, Args &&...args) {
+        return TryEmplace(std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    /// Erases elements.
+    void erase(const KeyType &key) {
+        Erase(key);
+    }
+
+    /// Erases elements with a key equal to the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    void erase(const K &key) {
+        Erase(key);
+    }
+
+    /// Access specified element with bounds checking.
+    const MappedType &at(const KeyType &key) const {
+        return At(key);
+    }
+
+    /// Access specified element with bounds checking by the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    const MappedType &at(const K &key) const {
+        return At(key);
+    }
+
+    /// Access or insert specified element.
+    MappedType &operator[](const KeyType &key) {
+        return try_emplace(key).first->second;
+    }
+
+    /// Access or insert specified element.
+    MappedType &operator[](KeyType &&key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    /// Access or insert specified element by the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    MappedType &operator[](K &&key) {
+        return try_emplace(std::forward<K>(key)).first->second;
+    }
+
+    /// Finds element with specific key.
+    iterator find(const KeyType &key) {
+        return FindIterator(key);
+    }
+
+    /// Finds element with specific key.
+    const_iterator find(const KeyType &key) const {
+        return FindIterator(key);
+    }
+
+    /// Finds element with a key equal to the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    iterator find(const K &key) {
+        return FindIterator(key);
+    }
+
+    /// Finds element with a key equal to the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    const_iterator find(const K &key) const {
+        return FindIterator(key);
+    }
+
+    /// Returns a read/write iterator that points to the first element in the hash map.
+    iterator begin() {
+        return values_.begin();
+    }
+
+    /// Returns a read/write iterator that points one past the last element in the hash map.
+    iterator end() {
+        return values_.end();
+    }
+
+    /// Returns a read-only (constant) iterator that points to the first element in the hash map.
+    const_iterator begin() const {
+        return values_.begin();
+    }
+
+    /// Returns a read-only (constant) iterator that points one past the last element in the hash map.
+    const_iterator end() const {
+        return values_.end();
+    }
+
+    /// Returns function used to hash the keys.
+    Hasher hash_function() const {
+        return hasher_;
+    }
+
+    /// Returns function used to compare the keys for equality.
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+private:
+    using ValueContainer = typename Storage::template Container<ValueType>;
+    using Link = typename ValueContainer::Link;
+
+    /// Information stored in a slot. Whether the slot is used is kept in its control byte.
+    struct Slot : Link {
+        SlotIndex rev_pos;
+    };
+
+    static_assert(std::is_unsigned_v<SlotIndex>, "SlotIndex must be an unsigned integer type");
+
+    /// The hash is mixed, since the group is taken by the mask. Its highest 7 bits are the fragment kept in the control
+    /// byte, and the lower ones choose the group.
+
+    static SizeType Mix(SizeType hash) {
+        return hash * 0x9E3779B97F4A7C15ull;
+    }
+
+    static int8_t Fragment(SizeType mixed) {
+        return static_cast<int8_t>(mixed >> 57ull);
+    }
+
+    /// Returns the first group of the probe sequence.
+    SizeType FirstGroup(SizeType mixed) const {
+        return (mixed ^ (mixed >> 32ull)) & group_mask_;
+    }
+
+    /// Inserts the element constructed from the key and args, if there is no element with an equal key.
+    template <class K, class... Args>
+    std::pair<iterator, bool> TryEmplace(K &&key, Args &&...args) {
+        SizeType hash = hasher_(key);
+        SizeType pos = Find(key, hash);
+        if (pos != NONE) {
+            return {GetIterator(pos), false};
+        }
+        values_.EmplaceBack(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+        return {GetIterator(Insert(hash)), true};
+    }
+
+    /// Erases the element with a key equal to the given one.
+    template <class K>
+    void Erase(const K &key) {
+        SizeType pos = Find(key, hasher_(key));
+        if (pos == NONE) {
+            return;
+        }
+        const Slot &slot = slots_[pos];
+        slots_[positions_.back()].rev_pos = slot.rev_pos;
+        std::swap(positions_[slot.rev_pos], positions_.back());
+        positions_.pop_back();
+        values_.Erase(slot, slot.rev_pos);
+
+        /// Probes stop at the first group with an empty slot. If the group of the slot already has one, then no probe
+        /// passes through it, and the slot can become empty. Otherwise some probe may continue after it.
+        SizeType base = pos & ~(ControlGroup::WIDTH - 1);
+        if (ControlGroup(&ctrl_[base]).MatchEmpty() != 0) {
+            ctrl_[pos] = ControlGroup::EMPTY;
+            ++growth_left_;
+        } else {
+            ctrl_[pos] = ControlGroup::DELETED;
+            ++deleted_count_;
+        }
+    }
+
+    /// Returns the mapped value of the element with a key equal to the given one.
+    template <class K>
+    const MappedType &At(const K &key) const {
+        auto it = FindIterator(key);
+        if (it == end()) {
+            throw std::out_of_range("_Map_base::at");
+        }
+        return it->second;
+    }
+
+    /// Finds the element with a key equal to the given one.
+    template <class K>
+    iterator FindIterator(const K &key) {
+        SizeType pos = Find(key, hasher_(key));
+        if (pos == NONE) {
+            return end();
+        }
+        return GetIterator(pos);
+    }
+
+    /// Finds the element with a key equal to the given one.
+    template <class K>
+    const_iterator FindIterator(const K &key) const {
+        SizeType pos = Find(key, hasher_(key));
+        if (pos == NONE) {
+            return end();
+        }
+        return GetIterator(pos);
+    }
+
+    /// Returns iterator to the element stored in the used slot.
+    iterator GetIterator(SizeType pos) {
+        return values_.Iterator(slots_[pos], slots_[pos].rev_pos);
+    }
+
+    /// Returns iterator to the element stored in the used slot.
+    const_iterator GetIterator(SizeType pos) const {
+        return values_.Iterator(slots_[pos], slots_[pos].rev_pos);
+    }
+
+    /// Returns position of the slot with the key or NONE, if it is not in the table. Groups are probed by the
+    /// triangular sequence, that visits every group, since their number is a power of two.
+    template <class K>
+    SizeType Find(const K &key, SizeType hash) const {
+        if (ctrl_.empty()) {
+            return NONE;
+        }
+        SizeType mixed = Mix(hash);
+        int8_t fragment = Fragment(mixed);
+        SizeType group = FirstGroup(mixed);
+        for (SizeType step = 1;; ++step) {
+            SizeType base = group * ControlGroup::WIDTH;
+            ControlGroup control(&ctrl_[base]);
+            for (uint32_t mask = control.Match(fragment); mask != 0; mask &= mask - 1) {
+                SizeType pos = base + ControlGroup::LowestSlot(mask);
+                if (key_equal_(values_.Get(slots_[pos], slots_[pos].rev_pos).first, key)) {
+                    return pos;
+                }
+            }
+            if (control.MatchEmpty() != 0) {
+                return NONE;
+            }
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    /// Links the last element of values_, whose key doesn't exist in the table, and returns position of its slot. If
+    /// the rebuild of the table throws, the element is removed from values_, so no element is left without a slot.
+    SizeType Insert(SizeType hash) {
+        try {
+            /// The position is reserved first, so that nothing throws after the slot is taken.
+            if (positions_.size() == positions_.capacity()) {
+                positions_.reserve(std::max<SizeType>(positions_.size() << 1ull, 1));
+            }
+            while (growth_left_ == 0) {
+                /// If deleted slots take the place, then rebuild the table of the same size, otherwise grow it.
+                Rehash(size() < MaxElementCount(ctrl_.size()) / 2 ? ctrl_.size() : ctrl_.size() << 1ull);
+            }
+        } catch (...) {
+            values_.PopBack();
+            throw;
+        }
+        SizeType pos = Place(hash);
+        Fill(pos, values_.GetLink(std::prev(values_.end())), positions_.size());
+        positions_.push_back(pos);
+        return pos;
+    }
+
+    /// Takes the first free slot in the probe sequence of the hash and returns its position.
+    SizeType Place(SizeType hash) {
+        SizeType mixed = Mix(hash);
+        SizeType group = FirstGroup(mixed);
+        for (SizeType step = 1;; ++step) {
+            SizeType base = group * ControlGroup::WIDTH;
+            uint32_t mask = ControlGroup(&ctrl_[base]).MatchFree();
+            if (mask != 0) {
+                SizeType pos = base + ControlGroup::LowestSlot(mask);
+                if (ctrl_[pos] == ControlGroup::DELETED) {
+                    --deleted_count_;
+                } else {
+                    --growth_left_;
+                }
+                ctrl_[pos] = Fragment(mixed);
+                return pos;
+            }
+            group = (group + step) & group_mask_;
+        }
+    }
+
+    /// Makes the slot refer to the element.
+    void Fill(SizeType pos, const Link &link, SizeType rev_pos) {
+        static_cast<Link &>(slots_[pos]) = link;
+        slots_[pos].rev_pos = static_cast<SlotIndex>(rev_pos);
+    }
+
+    /// Returns the number of elements and deleted slots, that the table with the given number of slots contains
+    /// without growing.
+    SizeType MaxElementCount(SizeType capacity) const {
+        return std::min(static_cast<SizeType>(capacity * static_cast<double>(max_load_factor_)), capacity - 1);
+    }
+
+    /// Returns the minimum number of slots, that contains n elements without growing.
+    SizeType MinCapacity(SizeType n) const {
+        return static_cast<SizeType>(std::ceil(n / static_cast<double>(max_load_factor_))) + 1;
+    }
+
+    /// Rebuilds the table so that it has at least n slots. Elements are neither copied nor moved, only the slots are
+    /// relinked to them, so iterators and references stay valid.
+    void Rehash(SizeType n) {
+        SizeType group_count = 1;
+        while (group_count * ControlGroup::WIDTH < n) {
+            group_count <<= 1ull;
+        }
+        SizeType capacity = group_count * ControlGroup::WIDTH;
+        /// Reserved value of SlotIndex can't be position of an element.
+        if (capacity - 1 > static_cast<SlotIndex>(-1)) {
+            throw std::length_error("GroupHashMap: too many slots for SlotIndex");
+        }
+        /// The keys are hashed and the new table is allocated before the old one is touched, so a throwing hasher or
+        /// allocator leaves the map as it was. Placing the elements doesn't throw.
+        std::vector<SizeType> hashes(positions_.size());
+        for (SizeType i = 0; i < positions_.size(); ++i) {
+            hashes[i] = hasher_(values_.Get(slots_[positions_[i]], i).first);
+        }
+        std::vector<Slot> old_slots(capacity);
+        std::vector<int8_t> ctrl(capacity, ControlGroup::EMPTY);
+        old_slots.swap(slots_);
+        ctrl_.swap(ctrl);
+        group_mask_ = group_count - 1;
+        deleted_count_ = 0;
+        growth_left_ = MaxElementCount(capacity);
+        for (SizeType i = 0; i < positions_.size(); ++i) {
+            const Slot &old_slot = old_slots[positions_[i]];
+            SizeType pos = Place(hashes[i]);
+            Fill(pos, old_slot, i);
+            positions_[i] = pos;
+        }
+    }
+
+    /// Private fields:
+
+    /// Values contained in the table.
+    ValueContainer values_;
+    /// Positions of the values in the table.
+    std::vector<SizeType> positions_;
+    /// Control bytes of the slots.
+    std::vector<int8_t> ctrl_;
+    /// Slots of the table.
+    std::vector<Slot> slots_;
+    /// Number of groups minus one, the mask of the group index.
+    SizeType group_mask_ = 0;
+    /// Number of empty slots, that can be taken before the table is rebuilt.
+    SizeType growth_left_ = 0;
+    /// Number of deleted slots.
+    SizeType deleted_count_ = 0;
+    /// Load factor, after which the table grows.
+    float max_load_factor_ = 0.875;
+    /// Function used to hash the keys.
+    Hasher hasher_;
+    /// Function used to compare the keys for equality.
+    KeyEqual key_equal_;
+
+    /// NONE means there is no slot with the key.
+    static constexpr SizeType NONE = -1;
+};
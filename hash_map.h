@@ -1,730 +1,3016 @@
-#pragma once
-
-#include <cstdint>
-#include <functional>
-#include <list>
-#include <stdexcept>
-#include <vector>
-
-/// Hash map is an associative container that contains key-value pairs with unique keys. Search, insertion, and removal
-/// of elements have average constant-time complexity. A strategy of collision resolution is coalesced hashing with the
-/// cellar.
-template <class Key, class T, class Hash = std::hash<Key>>
-class HashMap {
-public:
-    /// Public typedefs:
-
-    using KeyType = Key;
-    using MappedType = T;
-    using ValueType = std::pair<const Key, T>;
-    using SizeType = size_t;
-    using Hasher = Hash;
-
-    /// Since values are contained in the list, its iterators are used. Iterator-related typedefs:
-
-    using iterator = typename std::list<ValueType>::iterator;              // NOLINT
-    using const_iterator = typename std::list<ValueType>::const_iterator;  // NOLINT
-
-    /// Default constructor creates no elements.
-    explicit HashMap(const Hasher &hf = Hasher()) : hasher_(hf) {
-        Rehash(0);
-    }
-
-    /// Create an hash map consisting of copies of the elements from [first, last).
-    template <typename InputIterator>
-    HashMap(InputIterator first, InputIterator last, const Hasher &hf = Hasher()) : HashMap(hf) {
-        for (auto it = first; it != last; ++it) {
-            values_.push_back(*it);
-        }
-        Rehash(values_.size() << 1ull);
-    }
-
-    /// Create an hash map consisting of copies of the elements in the list.
-    HashMap(std::initializer_list<std::pair<KeyType, MappedType>> list, const Hasher &hf = Hasher()) : HashMap(hf) {
-        auto list_iterator = list.begin();
-        for (size_t i = 0; i < list.size(); ++i) {
-            values_.push_back(*list_iterator);
-            ++list_iterator;
-        }
-        Rehash(values_.size() << 1ull);
-    }
-
-    /// Copy constructor.
-    HashMap(const HashMap &other) {
-        values_.clear();
-        positions_.clear();
-        element_count_ = 0;
-        primary_size_ = other.primary_size_;
-        cellar_size_ = other.cellar_size_;
-        start_pos_ = primary_size_ + cellar_size_ - 1;
-        hasher_ = other.hasher_;
-        std::list<ValueType> values(other.values_);
-        data_.assign(primary_size_ + cellar_size_, Data());
-        for (const auto &x : values) {
-            Insert(x, hasher_(x.first) % primary_size_);
-        }
-    }
-
-    /// Copy assignment operator.
-    HashMap &operator=(const HashMap &other) {
-        if (this->values_ != other.values_) {
-            values_.clear();
-            positions_.clear();
-            element_count_ = 0;
-            primary_size_ = other.primary_size_;
-            cellar_size_ = other.cellar_size_;
-            start_pos_ = primary_size_ + cellar_size_ - 1;
-            hasher_ = other.hasher_;
-            std::list<ValueType> values(other.values_);
-            data_.assign(primary_size_ + cellar_size_, Data());
-            for (const auto &x : values) {
-                Insert(x, hasher_(x.first) % primary_size_);
-            }
-        }
-        return *this;
-    }
-
-    /// Returns the number of elements.
-    SizeType size() const {
-        return element_count_;
-    }
-
-    /// Checks whether the container is empty.
-    bool empty() const {
-        return size() == 0;
-    }
-
-    /// Clears the contents.
-    void clear() {
-        values_.clear();
-        for (auto pos : positions_) {
-            data_[pos] = Data();
-        }
-        positions_.clear();
-        element_count_ = 0;
-        start_pos_ = primary_size_ + cellar_size_ - 1;
-    }
-
-    /// Inserts elements.
-    void insert(const ValueType &x) {
-        SizeType h = hasher_(x.first) % primary_size_;
-        if (Find(x.first, h) == NONE) {
-            Insert(x, h);
-        }
-    }
-
-    /// Erases elements.
-    void erase(const KeyType &key) {
-        SizeType pos = Find(key, hasher_(key) % primary_size_);
-        if (pos != NONE) {
-            data_[positions_.back()].rev_pos = data_[pos].rev_pos;
-            std::swap(positions_[data_[pos].rev_pos], positions_.back());
-            positions_.pop_back();
-            values_.erase(data_[pos].value);
-            data_[pos].value = iterator();
-            data_[pos].used = false;
-            data_[pos].deleted = true;
-            --element_count_;
-        }
-    }
-
-    /// Access specified element with bounds checking.
-    const MappedType &at(const KeyType &key) const {
-        auto it = find(key);
-        if (it == end()) {
-            throw std::out_of_range("_Map_base::at");
-        }
-        return it->second;
-    }
-
-    /// Access or insert specified element.
-    MappedType &operator[](const KeyType &key) {
-        SizeType h = hasher_(key) % primary_size_;
-        SizeType pos = Find(key, h);
-        if (pos != NONE) {
-            return data_[pos].value->second;
-        }
-        return data_[Insert({key, MappedType()}, h)].value->second;
-    }
-
-    /// Finds element with specific key.
-    iterator find(const KeyType &key) {
-        SizeType pos = Find(key, hasher_(key) % primary_size_);
-        if (pos == NONE) {
-            return end();
-        }
-        return data_[pos].value;
-    }
-
-    /// Finds element with specific key.
-    const_iterator find(const KeyType &key) const {
-        SizeType pos = Find(key, hasher_(key) % primary_size_);
-        if (pos == NONE) {
-            return end();
-        }
-        return data_[pos].value;
-    }
-
-    /// Returns a read/write iterator that points to the first element in the hash map.
-    iterator begin() {
-        return values_.begin();
-    }
-
-    /// Returns a read/write iterator that points one past the last element in the hash map.
-    iterator end() {
-        return values_.end();
-    }
-
-    /// Returns a read-only (constant) iterator that points to the first element in the hash map.
-    const_iterator begin() const {
-        return values_.begin();
-    }
-
-    /// Returns a read-only (constant) iterator that points one past the last element in the hash map.
-    const_iterator end() const {
-        return values_.end();
-    }
-
-    /// Returns function used to hash the keys.
-    Hasher hash_function() const {
-        return hasher_;
-    }
-
-private:
-    /// Information stored in a slot.
-    struct Data {
-        iterator value;
-        bool used;
-        bool deleted;
-        SizeType rev_pos;
-        SizeType next;
-        Data() : used(false), deleted(false), next(NONE){};
-    };
-
-    /// Returns position of the key in the table or NONE, if it is not in it.
-    SizeType Find(const KeyType &key, SizeType pos) const {
-        while (true) {
-            if (pos == NONE) {
-                return NONE;
-            }
-            if (data_[pos].used) {
-                if (data_[pos].value->first == key) {
-                    return pos;
-                }
-            } else if (!data_[pos].deleted) {
-                return NONE;
-            }
-            /// Using link.
-            pos = data_[pos].next;
-        }
-    }
-
-    /// Inserts the key that doesn't exist and returns it position in the table.
-    SizeType Insert(const ValueType &value, SizeType pos) {
-        /// If load factor is more than 0.5, then rehash the table.
-        if ((element_count_ << 1ull) > primary_size_) {
-            Rehash(primary_size_ << 1ull);
-            pos = hasher_(value.first) % primary_size_;
-        }
-
-        if (data_[pos].used) {
-            SizeType distance = 0;
-            while (data_[pos].next != NONE && !data_[pos].deleted) {
-                pos = data_[pos].next;
-                ++distance;
-            }
-            if (data_[pos].used) {
-                SizeType next_free = start_pos_;
-                while (data_[next_free].used) {
-                    if (next_free == 0) {
-                        next_free = primary_size_ + cellar_size_ - 1;
-                    } else {
-                        --next_free;
-                    }
-                    ++distance;
-                    /// If distance is more than max lookups, then immediately rehash the table. Load factor should be
-                    /// more than 0.25 in case of a bad hash function.
-                    if ((element_count_ << 2ull) > primary_size_ && distance > GetMaxLookups(primary_size_)) {
-                        Rehash(primary_size_ << 1ull);
-                        return Insert(value, hasher_(value.first) % primary_size_);
-                    }
-                }
-                start_pos_ = next_free;
-                data_[pos].next = next_free;
-                pos = next_free;
-            }
-        }
-
-        values_.push_back(value);
-        data_[pos].value = (--values_.end());
-        data_[pos].used = true;
-        data_[pos].deleted = false;
-        data_[pos].rev_pos = positions_.size();
-        positions_.push_back(pos);
-        ++element_count_;
-
-        return pos;
-    }
-
-    /// Returns the next prime number from PRIMES.
-    SizeType NextPrime(SizeType value) const {
-        return *std::lower_bound(std::begin(PRIMES) + 1, std::end(PRIMES) - 1, value);
-    }
-
-    /// Rebuilds the table so that the primary_size_ is at least n.
-    void Rehash(SizeType n) {
-        element_count_ = 0;
-        primary_size_ = NextPrime(n);
-        cellar_size_ = primary_size_ * B + 1;
-        start_pos_ = primary_size_ + cellar_size_ - 1;
-        data_.assign(primary_size_ + cellar_size_, Data());
-        if (!values_.empty()) {
-            std::list<ValueType> values_copy(values_);
-            values_.clear();
-            positions_.clear();
-            for (const auto &value : values_copy) {
-                Insert(value, hasher_(value.first) % primary_size_);
-            }
-        }
-    }
-
-    /// Private fields:
-
-    /// Values contained in the table.
-    std::list<ValueType> values_;
-    /// Positions of the values in the table.
-    std::vector<SizeType> positions_;
-    /// Slots of the table.
-    std::vector<Data> data_;
-    /// Number of elements in the table.
-    SizeType element_count_;
-    /// Size of the addressable part. Slots to which keys can hash to.
-    SizeType primary_size_;
-    /// Size of the cellar. Slots used when dealing with collisions.
-    SizeType cellar_size_;
-    /// Start position for searching slot to insert. Common it is always (primary_size_ + cellar_size_ - 1). Here it is
-    /// recalculated after insertion.
-    SizeType start_pos_;
-    /// Function used to hash the keys.
-    Hasher hasher_;
-
-    /// NONE is means there is no link to the next element in chain.
-    static constexpr SizeType NONE = -1;
-    /// Let (cellar_size_ = B * primary_size_). The article says that this is the optimal value.
-    static constexpr float B = 7 / 43.;
-    /// Prime numbers for grow policy. The last is about 2^64.
-    // clang-format off
-    static constexpr SizeType PRIMES[] = {
-        2ull, 3ull, 5ull, 7ull, 11ull, 13ull, 17ull, 23ull, 29ull, 37ull, 47ull,
-        59ull, 73ull, 97ull, 127ull, 151ull, 197ull, 251ull, 313ull, 397ull,
-        499ull, 631ull, 797ull, 1009ull, 1259ull, 1597ull, 2011ull, 2539ull,
-        3203ull, 4027ull, 5087ull, 6421ull, 8089ull, 10193ull, 12853ull, 16193ull,
-        20399ull, 25717ull, 32401ull, 40823ull, 51437ull, 64811ull, 81649ull,
-        102877ull, 129607ull, 163307ull, 205759ull, 259229ull, 326617ull,
-        411527ull, 518509ull, 653267ull, 823117ull, 1037059ull, 1306601ull,
-        1646237ull, 2074129ull, 2613229ull, 3292489ull, 4148279ull, 5226491ull,
-        6584983ull, 8296553ull, 10453007ull, 13169977ull, 16593127ull, 20906033ull,
-        26339969ull, 33186281ull, 41812097ull, 52679969ull, 66372617ull,
-        83624237ull, 105359939ull, 132745199ull, 167248483ull, 210719881ull,
-        265490441ull, 334496971ull, 421439783ull, 530980861ull, 668993977ull,
-        842879579ull, 1061961721ull, 1337987929ull, 1685759167ull, 2123923447ull,
-        2675975881ull, 3371518343ull, 4247846927ull, 5351951779ull, 6743036717ull,
-        8495693897ull, 10703903591ull, 13486073473ull, 16991387857ull,
-        21407807219ull, 26972146961ull, 33982775741ull, 42815614441ull,
-        53944293929ull, 67965551447ull, 85631228929ull, 107888587883ull,
-        135931102921ull, 171262457903ull, 215777175787ull, 271862205833ull,
-        342524915839ull, 431554351609ull, 543724411781ull, 685049831731ull,
-        863108703229ull, 1087448823553ull, 1370099663459ull, 1726217406467ull,
-        2174897647073ull, 2740199326961ull, 3452434812973ull, 4349795294267ull,
-        5480398654009ull, 6904869625999ull, 8699590588571ull, 10960797308051ull,
-        13809739252051ull, 17399181177241ull, 21921594616111ull, 27619478504183ull,
-        34798362354533ull, 43843189232363ull, 55238957008387ull, 69596724709081ull,
-        87686378464759ull, 110477914016779ull, 139193449418173ull,
-        175372756929481ull, 220955828033581ull, 278386898836457ull,
-        350745513859007ull, 441911656067171ull, 556773797672909ull,
-        701491027718027ull, 883823312134381ull, 1113547595345903ull,
-        1402982055436147ull, 1767646624268779ull, 2227095190691797ull,
-        2805964110872297ull, 3535293248537579ull, 4454190381383713ull,
-        5611928221744609ull, 7070586497075177ull, 8908380762767489ull,
-        11223856443489329ull, 14141172994150357ull, 17816761525534927ull,
-        22447712886978529ull, 28282345988300791ull, 35633523051069991ull,
-        44895425773957261ull, 56564691976601587ull, 71267046102139967ull,
-        89790851547914507ull, 113129383953203213ull, 142534092204280003ull,
-        179581703095829107ull, 226258767906406483ull, 285068184408560057ull,
-        359163406191658253ull, 452517535812813007ull, 570136368817120201ull,
-        718326812383316683ull, 905035071625626043ull, 1140272737634240411ull,
-        1436653624766633509ull, 1810070143251252131ull, 2280545475268481167ull,
-        2873307249533267101ull, 3620140286502504283ull, 4561090950536962147ull,
-        5746614499066534157ull, 7240280573005008577ull, 9122181901073924329ull,
-        11493228998133068689ull, 14480561146010017169ull, 18446744073709551557ull
-    };
-    // clang-format on
-
-    /// Max lookups is log2 of primary_size_.
-    inline static SizeType GetMaxLookups(SizeType primary_size) {
-        switch (primary_size) {
-            case 17llu:
-                return 5;
-            case 23llu:
-                return 5;
-            case 29llu:
-                return 5;
-            case 37llu:
-                return 6;
-            case 47llu:
-                return 6;
-            case 59llu:
-                return 6;
-            case 73llu:
-                return 7;
-            case 97llu:
-                return 7;
-            case 127llu:
-                return 7;
-            case 151llu:
-                return 8;
-            case 197llu:
-                return 8;
-            case 251llu:
-                return 8;
-            case 313llu:
-                return 9;
-            case 397llu:
-                return 9;
-            case 499llu:
-                return 9;
-            case 631llu:
-                return 10;
-            case 797llu:
-                return 10;
-            case 1009llu:
-                return 10;
-            case 1259llu:
-                return 11;
-            case 1597llu:
-                return 11;
-            case 2011llu:
-                return 11;
-            case 2539llu:
-                return 12;
-            case 3203llu:
-                return 12;
-            case 4027llu:
-                return 12;
-            case 5087llu:
-                return 13;
-            case 6421llu:
-                return 13;
-            case 8089llu:
-                return 13;
-            case 10193llu:
-                return 14;
-            case 12853llu:
-                return 14;
-            case 16193llu:
-                return 14;
-            case 20399llu:
-                return 15;
-            case 25717llu:
-                return 15;
-            case 32401llu:
-                return 15;
-            case 40823llu:
-                return 16;
-            case 51437llu:
-                return 16;
-            case 64811llu:
-                return 16;
-            case 81649llu:
-                return 17;
-            case 102877llu:
-                return 17;
-            case 129607llu:
-                return 17;
-            case 163307llu:
-                return 18;
-            case 205759llu:
-                return 18;
-            case 259229llu:
-                return 18;
-            case 326617llu:
-                return 19;
-            case 411527llu:
-                return 19;
-            case 518509llu:
-                return 19;
-            case 653267llu:
-                return 20;
-            case 823117llu:
-                return 20;
-            case 1037059llu:
-                return 20;
-            case 1306601llu:
-                return 21;
-            case 1646237llu:
-                return 21;
-            case 2074129llu:
-                return 21;
-            case 2613229llu:
-                return 22;
-            case 3292489llu:
-                return 22;
-            case 4148279llu:
-                return 22;
-            case 5226491llu:
-                return 23;
-            case 6584983llu:
-                return 23;
-            case 8296553llu:
-                return 23;
-            case 10453007llu:
-                return 24;
-            case 13169977llu:
-                return 24;
-            case 16593127llu:
-                return 24;
-            case 20906033llu:
-                return 25;
-            case 26339969llu:
-                return 25;
-            case 33186281llu:
-                return 25;
-            case 41812097llu:
-                return 26;
-            case 52679969llu:
-                return 26;
-            case 66372617llu:
-                return 26;
-            case 83624237llu:
-                return 27;
-            case 105359939llu:
-                return 27;
-            case 132745199llu:
-                return 27;
-            case 167248483llu:
-                return 28;
-            case 210719881llu:
-                return 28;
-            case 265490441llu:
-                return 28;
-            case 334496971llu:
-                return 29;
-            case 421439783llu:
-                return 29;
-            case 530980861llu:
-                return 29;
-            case 668993977llu:
-                return 30;
-            case 842879579llu:
-                return 30;
-            case 1061961721llu:
-                return 30;
-            case 1337987929llu:
-                return 31;
-            case 1685759167llu:
-                return 31;
-            case 2123923447llu:
-                return 31;
-            case 2675975881llu:
-                return 32;
-            case 3371518343llu:
-                return 32;
-            case 4247846927llu:
-                return 32;
-            case 5351951779llu:
-                return 33;
-            case 6743036717llu:
-                return 33;
-            case 8495693897llu:
-                return 33;
-            case 10703903591llu:
-                return 34;
-            case 13486073473llu:
-                return 34;
-            case 16991387857llu:
-                return 34;
-            case 21407807219llu:
-                return 35;
-            case 26972146961llu:
-                return 35;
-            case 33982775741llu:
-                return 35;
-            case 42815614441llu:
-                return 36;
-            case 53944293929llu:
-                return 36;
-            case 67965551447llu:
-                return 36;
-            case 85631228929llu:
-                return 37;
-            case 107888587883llu:
-                return 37;
-            case 135931102921llu:
-                return 37;
-            case 171262457903llu:
-                return 38;
-            case 215777175787llu:
-                return 38;
-            case 271862205833llu:
-                return 38;
-            case 342524915839llu:
-                return 39;
-            case 431554351609llu:
-                return 39;
-            case 543724411781llu:
-                return 39;
-            case 685049831731llu:
-                return 40;
-            case 863108703229llu:
-                return 40;
-            case 1087448823553llu:
-                return 40;
-            case 1370099663459llu:
-                return 41;
-            case 1726217406467llu:
-                return 41;
-            case 2174897647073llu:
-                return 41;
-            case 2740199326961llu:
-                return 42;
-            case 3452434812973llu:
-                return 42;
-            case 4349795294267llu:
-                return 42;
-            case 5480398654009llu:
-                return 43;
-            case 6904869625999llu:
-                return 43;
-            case 8699590588571llu:
-                return 43;
-            case 10960797308051llu:
-                return 44;
-            case 13809739252051llu:
-                return 44;
-            case 17399181177241llu:
-                return 44;
-            case 21921594616111llu:
-                return 45;
-            case 27619478504183llu:
-                return 45;
-            case 34798362354533llu:
-                return 45;
-            case 43843189232363llu:
-                return 46;
-            case 55238957008387llu:
-                return 46;
-            case 69596724709081llu:
-                return 46;
-            case 87686378464759llu:
-                return 47;
-            case 110477914016779llu:
-                return 47;
-            case 139193449418173llu:
-                return 47;
-            case 175372756929481llu:
-                return 48;
-            case 220955828033581llu:
-                return 48;
-            case 278386898836457llu:
-                return 48;
-            case 350745513859007llu:
-                return 49;
-            case 441911656067171llu:
-                return 49;
-            case 556773797672909llu:
-                return 49;
-            case 701491027718027llu:
-                return 50;
-            case 883823312134381llu:
-                return 50;
-            case 1113547595345903llu:
-                return 50;
-            case 1402982055436147llu:
-                return 51;
-            case 1767646624268779llu:
-                return 51;
-            case 2227095190691797llu:
-                return 51;
-            case 2805964110872297llu:
-                return 52;
-            case 3535293248537579llu:
-                return 52;
-            case 4454190381383713llu:
-                return 52;
-            case 5611928221744609llu:
-                return 53;
-            case 7070586497075177llu:
-                return 53;
-            case 8908380762767489llu:
-                return 53;
-            case 11223856443489329llu:
-                return 54;
-            case 14141172994150357llu:
-                return 54;
-            case 17816761525534927llu:
-                return 54;
-            case 22447712886978529llu:
-                return 55;
-            case 28282345988300791llu:
-                return 55;
-            case 35633523051069991llu:
-                return 55;
-            case 44895425773957261llu:
-                return 56;
-            case 56564691976601587llu:
-                return 56;
-            case 71267046102139967llu:
-                return 56;
-            case 89790851547914507llu:
-                return 57;
-            case 113129383953203213llu:
-                return 57;
-            case 142534092204280003llu:
-                return 57;
-            case 179581703095829107llu:
-                return 58;
-            case 226258767906406483llu:
-                return 58;
-            case 285068184408560057llu:
-                return 58;
-            case 359163406191658253llu:
-                return 59;
-            case 452517535812813007llu:
-                return 59;
-            case 570136368817120201llu:
-                return 59;
-            case 718326812383316683llu:
-                return 60;
-            case 905035071625626043llu:
-                return 60;
-            case 1140272737634240411llu:
-                return 60;
-            case 1436653624766633509llu:
-                return 61;
-            case 1810070143251252131llu:
-                return 61;
-            case 2280545475268481167llu:
-                return 61;
-            case 2873307249533267101llu:
-                return 62;
-            case 3620140286502504283llu:
-                return 62;
-            case 4561090950536962147llu:
-                return 62;
-            case 5746614499066534157llu:
-                return 63;
-            case 7240280573005008577llu:
-                return 63;
-            case 9122181901073924329llu:
-                return 63;
-            case 11493228998133068689llu:
-                return 64;
-            case 14480561146010017169llu:
-                return 64;
-            case 18446744073709551557llu:
-                return 64;
-            default:
-                return 4;
-        }
-    }
-};
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <memory_resource>
+#include <new>
+#include <ostream>
+#include <random>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// Storage policy that keeps every element in its own node of a list. Iterators and references stay valid until the
+/// element is erased, iteration order is the insertion order, unless HashMap::move_to_back changes it.
+struct ListStorage {
+    template <class Value, class Allocator = std::allocator<Value>>
+    class Container {
+    public:
+        using iterator = typename std::list<Value, Allocator>::iterator;              // NOLINT
+        using const_iterator = typename std::list<Value, Allocator>::const_iterator;  // NOLINT
+        using Reference = Value &;
+        using ConstReference = const Value &;
+
+        explicit Container(const Allocator &alloc = Allocator()) : values_(alloc) {
+        }
+
+        /// Part of a slot that refers to the element.
+        struct Link {
+            iterator value;
+        };
+
+        /// Constructs the element at the end.
+        template <class... Args>
+        void EmplaceBack(Args &&...args) {
+            values_.emplace_back(std::forward<Args>(args)...);
+        }
+
+        /// Removes the last element.
+        void PopBack() {
+            values_.pop_back();
+        }
+
+        Value &Back() {
+            return values_.back();
+        }
+
+        /// Returns the link to the element by its iterator.
+        Link GetLink(iterator it) {
+            return {it};
+        }
+
+        /// Removes the element. Index is the position of the element in the positions of the table.
+        void Erase(const Link &link, size_t) {
+            values_.erase(link.value);
+        }
+
+        /// Moves the element to the end of the order. The node is relinked, so links and iterators stay valid.
+        void MoveToBack(const_iterator it) {
+            values_.splice(values_.end(), values_, it);
+        }
+
+        /// Copies the elements of other into this empty container in their order. Link(i) returns the link of the
+        /// element with index i, that refers to the element of other, and it is moved to the copy. Without erasures the
+        /// indices follow the list, otherwise the rest of the nodes sorted by the address pair up with the rest of the
+        /// links sorted by the address of their nodes. So no key is hashed.
+        template <class F>
+        void CopyFrom(const Container &other, F link) {
+            size_t index = 0;
+            auto it = other.values_.begin();
+            for (; it != other.values_.end() && &*link(index).value == &*it; ++it, ++index) {
+                link(index).value = values_.insert(values_.end(), *it);
+            }
+            if (it == other.values_.end()) {
+                return;
+            }
+            std::vector<std::pair<uintptr_t, size_t>> nodes;
+            std::vector<std::pair<uintptr_t, size_t>> links;
+            std::vector<iterator> copies;
+            nodes.reserve(other.values_.size() - index);
+            links.reserve(other.values_.size() - index);
+            copies.reserve(other.values_.size() - index);
+            for (; it != other.values_.end(); ++it) {
+                nodes.emplace_back(reinterpret_cast<uintptr_t>(&*it), copies.size());
+                copies.push_back(values_.insert(values_.end(), *it));
+            }
+            for (size_t i = index; i < other.values_.size(); ++i) {
+                links.emplace_back(reinterpret_cast<uintptr_t>(&*link(i).value), i);
+            }
+            std::sort(nodes.begin(), nodes.end());
+            std::sort(links.begin(), links.end());
+            for (size_t i = 0; i < links.size(); ++i) {
+                link(links[i].second).value = copies[nodes[i].second];
+            }
+        }
+
+        Value &Get(const Link &link, size_t) {
+            return *link.value;
+        }
+
+        const Value &Get(const Link &link, size_t) const {
+            return *link.value;
+        }
+
+        iterator Iterator(const Link &link, size_t) {
+            return link.value;
+        }
+
+        const_iterator Iterator(const Link &link, size_t) const {
+            return link.value;
+        }
+
+        iterator begin() {
+            return values_.begin();
+        }
+
+        iterator end() {
+            return values_.end();
+        }
+
+        const_iterator begin() const {
+            return values_.begin();
+        }
+
+        const_iterator end() const {
+            return values_.end();
+        }
+
+        bool empty() const {
+            return values_.empty();
+        }
+
+        size_t size() const {
+            return values_.size();
+        }
+
+        void clear() {
+            values_.clear();
+        }
+
+        /// Nodes are allocated one by one, so there is nothing to shrink.
+        void ShrinkToFit() {
+        }
+
+        /// Exchanges the elements, the allocators are swapped as the list does it.
+        void Swap(Container &other) {
+            values_.swap(other.values_);
+        }
+
+        /// Removes the elements and takes the allocator, as the copy assignment of a propagating allocator does it. The
+        /// list is made anew, since its copy assignment needs assignable elements.
+        void Reset(const Allocator &alloc) noexcept {
+            std::destroy_at(&values_);
+            ::new (static_cast<void *>(&values_)) decltype(values_)(alloc);
+        }
+
+        bool operator!=(const Container &other) const {
+            return values_ != other.values_;
+        }
+
+    private:
+        std::list<Value, Allocator> values_;
+    };
+};
+
+/// Storage policy that keeps the elements in a contiguous array. The element with index i lives in the slot
+/// positions_[i], so slots need no link to the element and a probe touches one more cache line at most. Erasing moves
+/// the last element into the hole, therefore iterators and references are invalidated by erase and by insert.
+struct DenseStorage {
+    template <class Value, class Allocator = std::allocator<Value>>
+    class Container {
+    public:
+        using iterator = typename std::vector<Value, Allocator>::iterator;              // NOLINT
+        using const_iterator = typename std::vector<Value, Allocator>::const_iterator;  // NOLINT
+        using Reference = Value &;
+        using ConstReference = const Value &;
+
+        explicit Container(const Allocator &alloc = Allocator()) : values_(alloc) {
+        }
+
+        /// Index of the element is enough, so the link is empty.
+        struct Link {};
+
+        /// Constructs the element at the end.
+        template <class... Args>
+        void EmplaceBack(Args &&...args) {
+            values_.emplace_back(std::forward<Args>(args)...);
+        }
+
+        /// Removes the last element.
+        void PopBack() {
+            values_.pop_back();
+        }
+
+        Value &Back() {
+            return values_.back();
+        }
+
+        /// Returns the link to the element by its iterator.
+        Link GetLink(iterator) {
+            return {};
+        }
+
+        /// Removes the element with swap-with-last, just like positions_ of the table do.
+        void Erase(const Link &, size_t index) {
+            if (index + 1 != values_.size()) {
+                /// Key is const, so the last element is moved into the hole by the reconstruction.
+                values_[index].~Value();
+                new (&values_[index]) Value(std::move(values_.back()));
+            }
+            values_.pop_back();
+        }
+
+        /// Copies the elements of other into this empty container, the links are indices and stay as they are.
+        template <class F>
+        void CopyFrom(const Container &other, F) {
+            values_.reserve(other.values_.size());
+            for (const auto &x : other.values_) {
+                values_.push_back(x);
+            }
+        }
+
+        Value &Get(const Link &, size_t index) {
+            return values_[index];
+        }
+
+        const Value &Get(const Link &, size_t index) const {
+            return values_[index];
+        }
+
+        iterator Iterator(const Link &, size_t index) {
+            return values_.begin() + index;
+        }
+
+        const_iterator Iterator(const Link &, size_t index) const {
+            return values_.begin() + index;
+        }
+
+        iterator begin() {
+            return values_.begin();
+        }
+
+        iterator end() {
+            return values_.end();
+        }
+
+        const_iterator begin() const {
+            return values_.begin();
+        }
+
+        const_iterator end() const {
+            return values_.end();
+        }
+
+        bool empty() const {
+            return values_.empty();
+        }
+
+        size_t size() const {
+            return values_.size();
+        }
+
+        void clear() {
+            values_.clear();
+        }
+
+        void ShrinkToFit() {
+            values_.shrink_to_fit();
+        }
+
+        /// Exchanges the elements, the allocators are swapped as the vector does it.
+        void Swap(Container &other) {
+            values_.swap(other.values_);
+        }
+
+        /// Removes the elements and takes the allocator, as the copy assignment of a propagating allocator does it. The
+        /// vector is made anew, since its copy assignment needs assignable elements.
+        void Reset(const Allocator &alloc) noexcept {
+            std::destroy_at(&values_);
+            ::new (static_cast<void *>(&values_)) decltype(values_)(alloc);
+        }
+
+        bool operator!=(const Container &other) const {
+            return values_ != other.values_;
+        }
+
+    private:
+        std::vector<Value, Allocator> values_;
+    };
+};
+
+/// Storage policy that splits the elements into the array of keys and the parallel array of mapped values, the
+/// structure of arrays. Probes compare keys, that lie densely without the mapped values between them, and a pass over
+/// the keys or over the mapped values alone streams one array. There is no pair object, so iterators return the pair
+/// of references std::pair<const Key &, T &> by value: it->first and it->second work as usual, but a range-for loop
+/// binds the elements by auto or auto &&, not by auto &. Erasing moves the last element into the hole, like
+/// DenseStorage does, therefore iterators and references are invalidated by erase and by insert.
+struct SplitStorage {
+    template <class Value, class Allocator = std::allocator<Value>>
+    class Container {
+        using Key = std::remove_const_t<typename Value::first_type>;
+        using Mapped = typename Value::second_type;
+        using KeyAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Key>;
+        using MappedAllocator = typename std::allocator_traits<Allocator>::template rebind_alloc<Mapped>;
+
+        /// Iterator walks both arrays together.
+        template <bool Const>
+        class PairIterator {
+            using MappedPointer = std::conditional_t<Const, const Mapped *, Mapped *>;
+
+        public:
+            using iterator_category = std::random_access_iterator_tag;                                   // NOLINT
+            using value_type = Value;                                                                    // NOLINT
+            using difference_type = std::ptrdiff_t;                                                      // NOLINT
+            using reference = std::pair<const Key &, std::conditional_t<Const, const Mapped &, Mapped &>>;  // NOLINT
+
+            /// Holds the pair of references for operator->.
+            struct pointer {  // NOLINT
+                reference value;
+
+                const reference *operator->() const {
+                    return &value;
+                }
+            };
+
+            PairIterator() = default;
+
+            /// Iterator converts to the const one.
+            template <bool C, class = std::enable_if_t<Const && !C>>
+            PairIterator(const PairIterator<C> &other) : key_(other.key_), mapped_(other.mapped_) {
+            }
+
+            reference operator*() const {
+                return {*key_, *mapped_};
+            }
+
+            pointer operator->() const {
+                return {**this};
+            }
+
+            reference operator[](difference_type n) const {
+                return *(*this + n);
+            }
+
+            PairIterator &operator++() {
+                ++key_;
+                ++mapped_;
+                return *this;
+            }
+
+            PairIterator operator++(int) {
+                PairIterator old = *this;
+                ++*this;
+                return old;
+            }
+
+            PairIterator &operator--() {
+                --key_;
+                --mapped_;
+                return *this;
+            }
+
+            PairIterator operator--(int) {
+                PairIterator old = *this;
+                --*this;
+                return old;
+            }
+
+            PairIterator &operator+=(difference_type n) {
+                key_ += n;
+                mapped_ += n;
+                return *this;
+            }
+
+            PairIterator &operator-=(difference_type n) {
+                return *this += -n;
+            }
+
+            PairIterator operator+(difference_type n) const {
+                return PairIterator(*this) += n;
+            }
+
+            PairIterator operator-(difference_type n) const {
+                return PairIterator(*this) -= n;
+            }
+
+            difference_type operator-(const PairIterator &other) const {
+                return key_ - other.key_;
+            }
+
+            bool operator==(const PairIterator &other) const {
+                return key_ == other.key_;
+            }
+
+            bool operator!=(const PairIterator &other) const {
+                return key_ != other.key_;
+            }
+
+            bool operator<(const PairIterator &other) const {
+                return key_ < other.key_;
+            }
+
+        private:
+            friend class Container;
+            friend class PairIterator<!Const>;
+
+            PairIterator(const Key *key, MappedPointer mapped) : key_(key), mapped_(mapped) {
+            }
+
+            const Key *key_ = nullptr;
+            MappedPointer mapped_ = nullptr;
+        };
+
+    public:
+        using iterator = PairIterator<false>;       // NOLINT
+        using const_iterator = PairIterator<true>;  // NOLINT
+        using Reference = typename iterator::reference;
+        using ConstReference = typename const_iterator::reference;
+
+        explicit Container(const Allocator &alloc = Allocator())
+            : keys_(KeyAllocator(alloc)), mapped_(MappedAllocator(alloc)) {
+        }
+
+        /// Index of the element is enough, so the link is empty.
+        struct Link {};
+
+        /// Constructs the element at the end from the arguments of a constructor of the pair: the pieces, a pair or
+        /// the key and the mapped value.
+        template <class... KeyArgs, class... MappedArgs>
+        void EmplaceBack(std::piecewise_construct_t, std::tuple<KeyArgs...> key_args,
+                         std::tuple<MappedArgs...> mapped_args) {
+            std::apply([this](auto &&...args) { keys_.emplace_back(std::forward<decltype(args)>(args)...); },
+                       std::move(key_args));
+            EmplaceMapped([&] {
+                std::apply([this](auto &&...args) { mapped_.emplace_back(std::forward<decltype(args)>(args)...); },
+                           std::move(mapped_args));
+            });
+        }
+
+        template <class K, class M>
+        void EmplaceBack(const std::pair<K, M> &x) {
+            keys_.emplace_back(x.first);
+            EmplaceMapped([&] { mapped_.emplace_back(x.second); });
+        }
+
+        template <class K, class M>
+        void EmplaceBack(std::pair<K, M> &&x) {
+            keys_.emplace_back(std::forward<K>(x.first));
+            EmplaceMapped([&] { mapped_.emplace_back(std::forward<M>(x.second)); });
+        }
+
+        template <class K, class M>
+        void EmplaceBack(K &&key, M &&mapped) {
+            keys_.emplace_back(std::forward<K>(key));
+            EmplaceMapped([&] { mapped_.emplace_back(std::forward<M>(mapped)); });
+        }
+
+        /// Removes the last element.
+        void PopBack() {
+            keys_.pop_back();
+            mapped_.pop_back();
+        }
+
+        Reference Back() {
+            return {keys_.back(), mapped_.back()};
+        }
+
+        /// Returns the link to the element by its iterator.
+        Link GetLink(iterator) {
+            return {};
+        }
+
+        /// Removes the element with swap-with-last. Keys of the array aren't const, so they are moved by assignment.
+        void Erase(const Link &, size_t index) {
+            if (index + 1 != keys_.size()) {
+                keys_[index] = std::move(keys_.back());
+                mapped_[index] = std::move(mapped_.back());
+            }
+            PopBack();
+        }
+
+        /// Copies the elements of other into this empty container, the links are indices and stay as they are.
+        template <class F>
+        void CopyFrom(const Container &other, F) {
+            keys_.assign(other.keys_.begin(), other.keys_.end());
+            mapped_.assign(other.mapped_.begin(), other.mapped_.end());
+        }
+
+        Reference Get(const Link &, size_t index) {
+            return {keys_[index], mapped_[index]};
+        }
+
+        ConstReference Get(const Link &, size_t index) const {
+            return {keys_[index], mapped_[index]};
+        }
+
+        iterator Iterator(const Link &, size_t index) {
+            return begin() + static_cast<std::ptrdiff_t>(index);
+        }
+
+        const_iterator Iterator(const Link &, size_t index) const {
+            return begin() + static_cast<std::ptrdiff_t>(index);
+        }
+
+        iterator begin() {
+            return {keys_.data(), mapped_.data()};
+        }
+
+        iterator end() {
+            return {keys_.data() + keys_.size(), mapped_.data() + mapped_.size()};
+        }
+
+        const_iterator begin() const {
+            return {keys_.data(), mapped_.data()};
+        }
+
+        const_iterator end() const {
+            return {keys_.data() + keys_.size(), mapped_.data() + mapped_.size()};
+        }
+
+        bool empty() const {
+            return keys_.empty();
+        }
+
+        size_t size() const {
+            return keys_.size();
+        }
+
+        void clear() {
+            keys_.clear();
+            mapped_.clear();
+        }
+
+        void ShrinkToFit() {
+            keys_.shrink_to_fit();
+            mapped_.shrink_to_fit();
+        }
+
+        /// Exchanges the elements, the allocators are swapped as the vector does it.
+        void Swap(Container &other) {
+            keys_.swap(other.keys_);
+            mapped_.swap(other.mapped_);
+        }
+
+        /// Removes the elements and takes the allocator, as the copy assignment of a propagating allocator does it.
+        void Reset(const Allocator &alloc) noexcept {
+            std::destroy_at(&keys_);
+            ::new (static_cast<void *>(&keys_)) decltype(keys_)(KeyAllocator(alloc));
+            std::destroy_at(&mapped_);
+            ::new (static_cast<void *>(&mapped_)) decltype(mapped_)(MappedAllocator(alloc));
+        }
+
+        bool operator!=(const Container &other) const {
+            return keys_ != other.keys_ || mapped_ != other.mapped_;
+        }
+
+    private:
+        /// Constructs the mapped value of the key, that is just added, by emplace, removing the key if it throws.
+        template <class F>
+        void EmplaceMapped(F emplace) {
+            try {
+                emplace();
+            } catch (...) {
+                keys_.pop_back();
+                throw;
+            }
+        }
+
+        std::vector<Key, KeyAllocator> keys_;
+        std::vector<Mapped, MappedAllocator> mapped_;
+    };
+};
+
+/// Grow policy that uses prime sizes of the addressable part and the remainder of the division.
+struct PrimeGrowPolicy {
+    /// Identifier of the policy kept in snapshots.
+    static constexpr uint32_t ID = 1;
+
+    /// Returns the size of the addressable part that is at least n. The binary search is written out, since
+    /// std::lower_bound isn't constexpr before C++20.
+    static constexpr size_t NextSize(size_t n) {
+        size_t low = 1, high = std::size(PRIMES) - 1;
+        while (low < high) {
+            size_t middle = (low + high) >> 1ull;
+            if (PRIMES[middle] < n) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        return PRIMES[low];
+    }
+
+    /// Returns the slot of the addressable part of the given size to which the hash goes.
+    static constexpr size_t Index(size_t hash, size_t size) {
+        return hash % size;
+    }
+
+    /// Prime numbers for grow policy. The last is about 2^64.
+    // clang-format off
+    static constexpr size_t PRIMES[] = {
+        2ull, 3ull, 5ull, 7ull, 11ull, 13ull, 17ull, 23ull, 29ull, 37ull, 47ull,
+        59ull, 73ull, 97ull, 127ull, 151ull, 197ull, 251ull, 313ull, 397ull,
+        499ull, 631ull, 797ull, 1009ull, 1259ull, 1597ull, 2011ull, 2539ull,
+        3203ull, 4027ull, 5087ull, 6421ull, 8089ull, 10193ull, 12853ull, 16193ull,
+        20399ull, 25717ull, 32401ull, 40823ull, 51437ull, 64811ull, 81649ull,
+        102877ull, 129607ull, 163307ull, 205759ull, 259229ull, 326617ull,
+        411527ull, 518509ull, 653267ull, 823117ull, 1037059ull, 1306601ull,
+        1646237ull, 2074129ull, 2613229ull, 3292489ull, 4148279ull, 5226491ull,
+        6584983ull, 8296553ull, 10453007ull, 13169977ull, 16593127ull, 20906033ull,
+        26339969ull, 33186281ull, 41812097ull, 52679969ull, 66372617ull,
+        83624237ull, 105359939ull, 132745199ull, 167248483ull, 210719881ull,
+        265490441ull, 334496971ull, 421439783ull, 530980861ull, 668993977ull,
+        842879579ull, 1061961721ull, 1337987929ull, 1685759167ull, 2123923447ull,
+        2675975881ull, 3371518343ull, 4247846927ull, 5351951779ull, 6743036717ull,
+        8495693897ull, 10703903591ull, 13486073473ull, 16991387857ull,
+        21407807219ull, 26972146961ull, 33982775741ull, 42815614441ull,
+        53944293929ull, 67965551447ull, 85631228929ull, 107888587883ull,
+        135931102921ull, 171262457903ull, 215777175787ull, 271862205833ull,
+        342524915839ull, 431554351609ull, 543724411781ull, 685049831731ull,
+        863108703229ull, 1087448823553ull, 1370099663459ull, 1726217406467ull,
+        2174897647073ull, 2740199326961ull, 3452434812973ull, 4349795294267ull,
+        5480398654009ull, 6904869625999ull, 8699590588571ull, 10960797308051ull,
+        13809739252051ull, 17399181177241ull, 21921594616111ull, 27619478504183ull,
+        34798362354533ull, 43843189232363ull, 55238957008387ull, 69596724709081ull,
+        87686378464759ull, 110477914016779ull, 139193449418173ull,
+        175372756929481ull, 220955828033581ull, 278386898836457ull,
+        350745513859007ull, 441911656067171ull, 556773797672909ull,
+        701491027718027ull, 883823312134381ull, 1113547595345903ull,
+        1402982055436147ull, 1767646624268779ull, 2227095190691797ull,
+        2805964110872297ull, 3535293248537579ull, 4454190381383713ull,
+        5611928221744609ull, 7070586497075177ull, 8908380762767489ull,
+        11223856443489329ull, 14141172994150357ull, 17816761525534927ull,
+        22447712886978529ull, 28282345988300791ull, 35633523051069991ull,
+        44895425773957261ull, 56564691976601587ull, 71267046102139967ull,
+        89790851547914507ull, 113129383953203213ull, 142534092204280003ull,
+        179581703095829107ull, 226258767906406483ull, 285068184408560057ull,
+        359163406191658253ull, 452517535812813007ull, 570136368817120201ull,
+        718326812383316683ull, 905035071625626043ull, 1140272737634240411ull,
+        1436653624766633509ull, 1810070143251252131ull, 2280545475268481167ull,
+        2873307249533267101ull, 3620140286502504283ull, 4561090950536962147ull,
+        5746614499066534157ull, 7240280573005008577ull, 9122181901073924329ull,
+        11493228998133068689ull, 14480561146010017169ull, 18446744073709551557ull
+    };
+    // clang-format on
+};
+
+/// Grow policy that uses power of two sizes of the addressable part, so the index is taken by the mask. The hash is
+/// mixed before, otherwise hashes with equal low bits, like identity hashes of aligned integers, would collide.
+struct PowerOfTwoGrowPolicy {
+    /// Identifier of the policy kept in snapshots.
+    static constexpr uint32_t ID = 2;
+
+    /// Returns the size of the addressable part that is at least n.
+    static constexpr size_t NextSize(size_t n) {
+        size_t size = 2;
+        while (size < n) {
+            size <<= 1ull;
+        }
+        return size;
+    }
+
+    /// Returns the slot of the addressable part of the given size to which the hash goes.
+    static constexpr size_t Index(size_t hash, size_t size) {
+        hash *= 0x9E3779B97F4A7C15ull;
+        return (hash ^ (hash >> 32ull)) & (size - 1);
+    }
+};
+
+/// Grow policy that keeps prime sizes of the addressable part, but maps the hash by the multiply-shift range reduction
+/// of Lemire instead of the division. The hash is multiplied by the odd constant before, since the reduction uses its
+/// high bits only.
+struct FastRangeGrowPolicy {
+    /// Identifier of the policy kept in snapshots.
+    static constexpr uint32_t ID = 3;
+
+    /// Returns the size of the addressable part that is at least n.
+    static constexpr size_t NextSize(size_t n) {
+        return PrimeGrowPolicy::NextSize(n);
+    }
+
+    /// Returns the slot of the addressable part of the given size to which the hash goes.
+    static constexpr size_t Index(size_t hash, size_t size) {
+        hash *= 0x9E3779B97F4A7C15ull;
+#ifdef __SIZEOF_INT128__
+        return static_cast<size_t>((static_cast<unsigned __int128>(hash) * size) >> 64ull);
+#else
+        uint64_t hash_low = hash & 0xFFFFFFFFull, hash_high = hash >> 32ull;
+        uint64_t size_low = size & 0xFFFFFFFFull, size_high = size >> 32ull;
+        uint64_t middle =
+            (hash_low * size_low >> 32ull) + (hash_high * size_low & 0xFFFFFFFFull) + hash_low * size_high;
+        return hash_high * size_high + (hash_high * size_low >> 32ull) + (middle >> 32ull);
+#endif
+    }
+};
+
+/// Hash cache policy that stores nothing in slots, so every probe compares the keys and every rehash calls the hasher.
+struct NoHashCache {
+    struct Field {};
+
+    /// Whether the stored hash is the whole hash and can be used instead of calling the hasher.
+    static constexpr bool REUSABLE = false;
+
+    static void Store(Field &, size_t) {
+    }
+
+    /// Returns false, if the element stored with the field certainly has another hash.
+    static bool Matches(const Field &, size_t) {
+        return true;
+    }
+};
+
+/// Hash cache policy that stores the whole hash in slots. Probes compare the keys only when the hashes are equal, and
+/// rehash takes hashes from the slots instead of calling the hasher.
+struct FullHashCache {
+    struct Field {
+        size_t hash;
+    };
+
+    /// Whether the stored hash is the whole hash and can be used instead of calling the hasher.
+    static constexpr bool REUSABLE = true;
+
+    static void Store(Field &field, size_t hash) {
+        field.hash = hash;
+    }
+
+    /// Returns false, if the element stored with the field certainly has another hash.
+    static bool Matches(const Field &field, size_t hash) {
+        return field.hash == hash;
+    }
+
+    static size_t Load(const Field &field) {
+        return field.hash;
+    }
+};
+
+/// Hash cache policy that stores 32 bits of the hash in slots. It only lets probes skip the key comparisons, rehash
+/// still calls the hasher.
+struct TruncatedHashCache {
+    struct Field {
+        uint32_t hash;
+    };
+
+    /// Whether the stored hash is the whole hash and can be used instead of calling the hasher.
+    static constexpr bool REUSABLE = false;
+
+    static void Store(Field &field, size_t hash) {
+        field.hash = Truncate(hash);
+    }
+
+    /// Returns false, if the element stored with the field certainly has another hash.
+    static bool Matches(const Field &field, size_t hash) {
+        return field.hash == Truncate(hash);
+    }
+
+    /// Both halves are mixed, since hashes of small integers have only the low one and for some grow policies the low
+    /// bits are the same in a chain.
+    static uint32_t Truncate(size_t hash) {
+        return static_cast<uint32_t>(hash ^ (static_cast<uint64_t>(hash) >> 32ull));
+    }
+};
+
+/// Counter of events for HashMapCounters. It is a relaxed atomic, since the const lookups count their probes, and the
+/// concurrent wrappers call them from many threads. Unlike std::atomic it is copyable, and it converts to its value.
+class StatsCounter {
+public:
+    StatsCounter() = default;
+
+    StatsCounter(const StatsCounter &other) noexcept : value_(other) {
+    }
+
+    StatsCounter &operator=(const StatsCounter &other) noexcept {
+        value_.store(other, std::memory_order_relaxed);
+        return *this;
+    }
+
+    StatsCounter &operator++() {
+        value_.fetch_add(1, std::memory_order_relaxed);
+        return *this;
+    }
+
+    StatsCounter &operator+=(uint64_t value) {
+        value_.fetch_add(value, std::memory_order_relaxed);
+        return *this;
+    }
+
+    operator uint64_t() const {  // NOLINT
+        return value_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value_{0};
+};
+
+/// Statistics of HashMap returned by stats(). The structure of the table is measured by stats() itself, the counters
+/// of events are collected only with the CollectStats policy and stay zero otherwise.
+struct HashMapStats {
+    /// Number of buckets of the probe histograms, the last one counts the probes of this length and longer.
+    static constexpr size_t PROBE_BUCKETS = 16;
+
+    /// Counters of events:
+
+    /// Number of lookups, that visited i + 1 slots, in the bucket i.
+    std::array<uint64_t, PROBE_BUCKETS> lookup_probes{};
+    /// Number of placements of elements, the rebuilds included, that visited i + 1 slots, in the bucket i.
+    std::array<uint64_t, PROBE_BUCKETS> insert_probes{};
+    /// Number of slots passed by the scans for an empty slot from start_pos_.
+    uint64_t cellar_scan_steps = 0;
+    /// Number of rebuilds of the table, the starts of incremental migrations included, and of those caused by the
+    /// load factor, by a probe longer than the maximum number of lookups and by the deleted slots. The rest are those
+    /// requested by rehash(), reserve(), compact() and others.
+    uint64_t rehash_count = 0;
+    uint64_t load_factor_rehashes = 0;
+    uint64_t long_probe_rehashes = 0;
+    uint64_t deleted_slot_rehashes = 0;
+    /// Time spent in the rebuilds of the table, the incremental migration is not included.
+    uint64_t rehash_nanoseconds = 0;
+
+    /// Structure of the current table:
+
+    /// Number and the average and maximum length of chains counted from the slots, that no slot links to.
+    size_t chain_count = 0;
+    double average_chain_length = 0;
+    size_t max_chain_length = 0;
+    /// Number of used slots in the cellar and its size.
+    size_t cellar_used = 0;
+    size_t cellar_size = 0;
+    /// Number of deleted slots.
+    size_t deleted_count = 0;
+};
+
+/// Counters of events, that CollectStats keeps in the map and stats() copies to HashMapStats. Their meaning is that of
+/// the fields of HashMapStats with the same names.
+struct HashMapCounters {
+    std::array<StatsCounter, HashMapStats::PROBE_BUCKETS> lookup_probes{};
+    std::array<StatsCounter, HashMapStats::PROBE_BUCKETS> insert_probes{};
+    StatsCounter cellar_scan_steps;
+    StatsCounter rehash_count;
+    StatsCounter load_factor_rehashes;
+    StatsCounter long_probe_rehashes;
+    StatsCounter deleted_slot_rehashes;
+    StatsCounter rehash_nanoseconds;
+
+    void CopyTo(HashMapStats &stats) const {
+        for (size_t i = 0; i < HashMapStats::PROBE_BUCKETS; ++i) {
+            stats.lookup_probes[i] = lookup_probes[i];
+            stats.insert_probes[i] = insert_probes[i];
+        }
+        stats.cellar_scan_steps = cellar_scan_steps;
+        stats.rehash_count = rehash_count;
+        stats.load_factor_rehashes = load_factor_rehashes;
+        stats.long_probe_rehashes = long_probe_rehashes;
+        stats.deleted_slot_rehashes = deleted_slot_rehashes;
+        stats.rehash_nanoseconds = rehash_nanoseconds;
+    }
+};
+
+/// Statistics policy that collects nothing, the counters of HashMapStats stay zero and the hooks are compiled out.
+struct NoStats {
+    static constexpr bool ENABLED = false;
+
+    struct Counters {};
+};
+
+/// Statistics policy that counts the probes and the rebuilds of the table for stats().
+struct CollectStats {
+    static constexpr bool ENABLED = true;
+
+    using Counters = HashMapCounters;
+};
+
+/// Pool of memory for small allocations like nodes of lists. Memory is taken from the system by big blocks, and freed
+/// small allocations are kept in free lists by their size class, so both allocation and deallocation cost a few
+/// instructions. Big allocations like tables go to the upstream resource directly, that is the global operator new by
+/// default. All blocks are freed at once with the pool. The pool is not thread-safe.
+class NodePool {
+public:
+    explicit NodePool(std::pmr::memory_resource *upstream = std::pmr::new_delete_resource()) : upstream_(upstream) {
+    }
+
+    NodePool(const NodePool &) = delete;
+    NodePool &operator=(const NodePool &) = delete;
+
+    ~NodePool() {
+        for (auto [block, size] : blocks_) {
+            upstream_->deallocate(block, size, GRANULARITY);
+        }
+    }
+
+    /// Returns the resource, that gives the blocks and the big allocations.
+    std::pmr::memory_resource *upstream() const {
+        return upstream_;
+    }
+
+    void *Allocate(size_t size, size_t alignment) {
+        if (size > MAX_SMALL_SIZE || alignment > GRANULARITY) {
+            return upstream_->allocate(size, alignment);
+        }
+        FreeNode *&free_list = free_lists_[SizeClass(size)];
+        if (free_list != nullptr) {
+            FreeNode *node = free_list;
+            free_list = node->next;
+            return node;
+        }
+        size = (SizeClass(size) + 1) * GRANULARITY;
+        if (static_cast<size_t>(end_ - current_) < size) {
+            block_size_ = std::min(block_size_ << 1ull, MAX_BLOCK_SIZE);
+            blocks_.reserve(blocks_.size() + 1);
+            current_ = static_cast<char *>(upstream_->allocate(block_size_, GRANULARITY));
+            end_ = current_ + block_size_;
+            blocks_.emplace_back(current_, block_size_);
+        }
+        void *result = current_;
+        current_ += size;
+        return result;
+    }
+
+    void Deallocate(void *pointer, size_t size, size_t alignment) {
+        if (size > MAX_SMALL_SIZE || alignment > GRANULARITY) {
+            upstream_->deallocate(pointer, size, alignment);
+            return;
+        }
+        FreeNode *&free_list = free_lists_[SizeClass(size)];
+        free_list = new (pointer) FreeNode{free_list};
+    }
+
+private:
+    struct FreeNode {
+        FreeNode *next;
+    };
+
+    static size_t SizeClass(size_t size) {
+        return size == 0 ? 0 : (size - 1) / GRANULARITY;
+    }
+
+    /// Sizes of small allocations are rounded up to GRANULARITY, which is also their alignment.
+    static constexpr size_t GRANULARITY = 16;
+    static constexpr size_t MAX_SMALL_SIZE = 256;
+    static constexpr size_t MAX_BLOCK_SIZE = 1ull << 20ull;
+
+    std::pmr::memory_resource *upstream_;
+    FreeNode *free_lists_[MAX_SMALL_SIZE / GRANULARITY] = {};
+    /// Blocks with their sizes.
+    std::vector<std::pair<void *, size_t>> blocks_;
+    char *current_ = nullptr;
+    char *end_ = nullptr;
+    size_t block_size_ = 1ull << 11ull;
+};
+
+/// Allocator that takes memory from a NodePool shared by its copies, so the nodes of a list given this allocator don't
+/// call malloc and free, and all of them are freed at once with the container. Copying a container gives the copy its
+/// own pool with the same upstream resource, since pools are not thread-safe, while the rebound copies inside one
+/// container share the pool.
+template <class T>
+class PoolAllocator {
+public:
+    using value_type = T;                                           // NOLINT
+    using propagate_on_container_copy_assignment = std::true_type;  // NOLINT
+    using propagate_on_container_move_assignment = std::true_type;  // NOLINT
+    using propagate_on_container_swap = std::true_type;             // NOLINT
+
+    PoolAllocator() : pool_(std::make_shared<NodePool>()) {
+    }
+
+    /// Creates the allocator with a new pool, that takes the memory from the upstream resource.
+    explicit PoolAllocator(std::pmr::memory_resource *upstream) : pool_(std::make_shared<NodePool>(upstream)) {
+    }
+
+    template <class U>
+    PoolAllocator(const PoolAllocator<U> &other) : pool_(other.pool_) {  // NOLINT
+    }
+
+    T *allocate(size_t n) {  // NOLINT
+        if (n > static_cast<size_t>(-1) / sizeof(T)) {
+            throw std::bad_array_new_length();
+        }
+        return static_cast<T *>(pool_->Allocate(n * sizeof(T), alignof(T)));
+    }
+
+    void deallocate(T *pointer, size_t n) {  // NOLINT
+        pool_->Deallocate(pointer, n * sizeof(T), alignof(T));
+    }
+
+    PoolAllocator select_on_container_copy_construction() const {  // NOLINT
+        return PoolAllocator(pool_->upstream());
+    }
+
+    template <class U>
+    bool operator==(const PoolAllocator<U> &other) const {
+        return pool_ == other.pool_;
+    }
+
+    template <class U>
+    bool operator!=(const PoolAllocator<U> &other) const {
+        return pool_ != other.pool_;
+    }
+
+private:
+    template <class U>
+    friend class PoolAllocator;
+
+    std::shared_ptr<NodePool> pool_;
+};
+
+/// Checks whether the function object type has is_transparent member type.
+template <class F, class = void>
+struct IsTransparent : std::false_type {};
+
+template <class F>
+struct IsTransparent<F, std::void_t<typename F::is_transparent>> : std::true_type {};
+
+/// Returns the seed of the hasher kept in snapshots. Hashers with seed() member report it, any other is unseeded.
+template <class F, class = void>
+struct HashSeed {
+    static uint64_t Get(const F &) {
+        return 0;
+    }
+};
+
+template <class F>
+struct HashSeed<F, std::void_t<decltype(std::declval<const F &>().seed())>> {
+    static uint64_t Get(const F &f) {
+        return static_cast<uint64_t>(f.seed());
+    }
+};
+
+/// Primitives of wyhash by Wang Yi: the 64x64->128 multiplication folded by xor, that mixes every input bit into every
+/// output bit in a few cycles, and the hash of bytes built on it. Reads are unaligned and in the native byte order.
+struct WyHash {
+    /// Replaces a and b by the low and the high halves of their full product.
+    static void Multiply(uint64_t &a, uint64_t &b) {
+#ifdef __SIZEOF_INT128__
+        auto product = static_cast<unsigned __int128>(a) * b;
+        a = static_cast<uint64_t>(product);
+        b = static_cast<uint64_t>(product >> 64ull);
+#else
+        uint64_t a_low = a & 0xFFFFFFFFull, a_high = a >> 32ull;
+        uint64_t b_low = b & 0xFFFFFFFFull, b_high = b >> 32ull;
+        uint64_t low_low = a_low * b_low, low_high = a_low * b_high, high_low = a_high * b_low;
+        uint64_t middle = (low_low >> 32ull) + (low_high & 0xFFFFFFFFull) + (high_low & 0xFFFFFFFFull);
+        a = (low_low & 0xFFFFFFFFull) | (middle << 32ull);
+        b = a_high * b_high + (low_high >> 32ull) + (high_low >> 32ull) + (middle >> 32ull);
+#endif
+    }
+
+    /// Returns the xor of the halves of the full product.
+    static uint64_t Mix(uint64_t a, uint64_t b) {
+        Multiply(a, b);
+        return a ^ b;
+    }
+
+    /// Returns the odd multiplier of the integer hash derived from the seed.
+    static uint64_t Multiplier(uint64_t seed) {
+        return Mix(seed ^ SECRET[0], SECRET[1]) | 1ull;
+    }
+
+    /// Hashes the integer by one folded multiplication, the multiplier is derived from the seed by Multiplier.
+    static uint64_t Hash(uint64_t x, uint64_t seed, uint64_t multiplier) {
+        return Mix(x ^ seed, multiplier);
+    }
+
+    /// Hashes size bytes from data.
+    static uint64_t Hash(const void *data, size_t size, uint64_t seed) {
+        const auto *p = static_cast<const unsigned char *>(data);
+        seed ^= Mix(seed ^ SECRET[0], SECRET[1]);
+        uint64_t a = 0, b = 0;
+        if (size <= 16) {
+            if (size >= 4) {
+                size_t shift = (size >> 3ull) << 2ull;
+                a = (Read4(p) << 32ull) | Read4(p + shift);
+                b = (Read4(p + size - 4) << 32ull) | Read4(p + size - 4 - shift);
+            } else if (size > 0) {
+                a = (static_cast<uint64_t>(p[0]) << 16ull) | (static_cast<uint64_t>(p[size >> 1ull]) << 8ull) |
+                    p[size - 1];
+            }
+        } else {
+            size_t left = size;
+            if (left > 48) {
+                uint64_t seed1 = seed, seed2 = seed;
+                do {
+                    seed = Mix(Read8(p) ^ SECRET[1], Read8(p + 8) ^ seed);
+                    seed1 = Mix(Read8(p + 16) ^ SECRET[2], Read8(p + 24) ^ seed1);
+                    seed2 = Mix(Read8(p + 32) ^ SECRET[3], Read8(p + 40) ^ seed2);
+                    p += 48;
+                    left -= 48;
+                } while (left > 48);
+                seed ^= seed1 ^ seed2;
+            }
+            while (left > 16) {
+                seed = Mix(Read8(p) ^ SECRET[1], Read8(p + 8) ^ seed);
+                p += 16;
+                left -= 16;
+            }
+            a = Read8(p + left - 16);
+            b = Read8(p + left - 8);
+        }
+        a ^= SECRET[1];
+        b ^= seed;
+        Multiply(a, b);
+        return Mix(a ^ SECRET[0] ^ size, b ^ SECRET[1]);
+    }
+
+    /// Returns a new unpredictable seed. The random device is read once, then the seeds are the mixed values of the
+    /// counter, so a seed costs an atomic increment.
+    static uint64_t RandomSeed() {
+        static std::atomic<uint64_t> counter{InitialSeed()};
+        return Mix(counter.fetch_add(0x9E3779B97F4A7C15ull, std::memory_order_relaxed) ^ SECRET[2], SECRET[3]);
+    }
+
+private:
+    static uint64_t Read8(const unsigned char *p) {
+        uint64_t x;
+        std::memcpy(&x, p, sizeof(x));
+        return x;
+    }
+
+    static uint64_t Read4(const unsigned char *p) {
+        uint32_t x;
+        std::memcpy(&x, p, sizeof(x));
+        return x;
+    }
+
+    /// The clock is mixed in, since the random device may be deterministic on some platforms.
+    static uint64_t InitialSeed() {
+        std::random_device device;
+        uint64_t seed = (static_cast<uint64_t>(device()) << 32ull) ^ device();
+        return seed ^ static_cast<uint64_t>(std::chrono::steady_clock::now().time_since_epoch().count());
+    }
+
+    /// Default secret of wyhash, odd constants with balanced bits.
+    static constexpr uint64_t SECRET[] = {0x2D358DCCAA6C78A5ull, 0x8BB84B93962EACC9ull, 0x4B33A62ED433D4A3ull,
+                                          0x4D5A2DA51DE1AA47ull};
+};
+
+/// Seeded hash is the fast hasher of good quality for untrusted keys. Integers and enums are mixed with the seed,
+/// strings are hashed by wyhash, any other key type K takes std::hash<K> and mixes its result. Every default
+/// constructed hasher draws a random seed, so collisions found against one map don't collide in another one, and
+/// crafted keys can't grow long chains. Copies keep the seed, so copies of the map hash alike. It is transparent, so a
+/// map with std::string keys is searched by std::string_view or const char * without a temporary, when the equality is
+/// transparent too.
+struct SeededHash {
+    using is_transparent = void;  // NOLINT
+
+    /// Creates the hasher with a random seed.
+    SeededHash() : SeededHash(WyHash::RandomSeed()) {
+    }
+
+    /// Creates the hasher with the given seed, so that hashes are reproducible, e.g. to read a snapshot.
+    explicit SeededHash(uint64_t seed) : seed_(seed), multiplier_(WyHash::Multiplier(seed)) {
+    }
+
+    template <class K, class = std::enable_if_t<std::is_integral_v<K> || std::is_enum_v<K>>>
+    size_t operator()(K key) const {
+        return static_cast<size_t>(WyHash::Hash(static_cast<uint64_t>(key), seed_, multiplier_));
+    }
+
+    size_t operator()(std::string_view key) const {
+        return static_cast<size_t>(WyHash::Hash(key.data(), key.size(), seed_));
+    }
+
+    template <class K, class = std::enable_if_t<!std::is_integral_v<K> && !std::is_enum_v<K> &&
+                                                !std::is_convertible_v<const K &, std::string_view>>>
+    size_t operator()(const K &key) const {
+        return static_cast<size_t>(WyHash::Hash(static_cast<uint64_t>(std::hash<K>()(key)), seed_, multiplier_));
+    }
+
+    uint64_t seed() const {
+        return seed_;
+    }
+
+private:
+    uint64_t seed_;
+    uint64_t multiplier_;
+};
+
+/// Mixed hash wraps the hasher, whose hashes may have a pattern, like the identity std::hash of integers does, and
+/// mixes every hash with the seed. So the grow policy sees uniform hashes and the chains can't be predicted, at the
+/// cost of one multiplication per hash. It is transparent, if the wrapped hasher is.
+template <class Hash>
+struct MixedHash : Hash {
+    /// Creates the wrapper of the hasher with a random seed.
+    explicit MixedHash(const Hash &hash = Hash()) : MixedHash(hash, WyHash::RandomSeed()) {
+    }
+
+    /// Creates the wrapper of the hasher with the given seed.
+    MixedHash(const Hash &hash, uint64_t seed) : Hash(hash), seed_(seed), multiplier_(WyHash::Multiplier(seed)) {
+    }
+
+    template <class K>
+    size_t operator()(const K &key) const {
+        return static_cast<size_t>(WyHash::Hash(static_cast<uint64_t>(Hash::operator()(key)), seed_, multiplier_));
+    }
+
+    uint64_t seed() const {
+        return seed_;
+    }
+
+private:
+    uint64_t seed_;
+    uint64_t multiplier_;
+};
+
+/// Binary snapshot of the table of HashMap with trivially copyable keys and values, that FrozenHashMap maps into memory
+/// and serves as is. The file consists of the header, the slots of the table and the elements in the order of their
+/// indices, both regions start at multiples of ALIGNMENT. Integers have the native byte order, so a foreign one breaks
+/// the magic number.
+struct SnapshotFormat {
+    struct Header {
+        uint64_t magic;
+        uint32_t version;
+        /// Identifier of the grow policy, that maps hashes to the slots.
+        uint32_t grow_policy;
+        /// Seed of the hasher, see HashSeed.
+        uint64_t hash_seed;
+        /// Sizes of the types, that must be the same for the reader.
+        uint32_t slot_index_size;
+        uint32_t key_size;
+        uint32_t mapped_size;
+        uint32_t value_size;
+        /// Size of the addressable part and of the whole table.
+        uint64_t primary_size;
+        uint64_t table_size;
+        uint64_t element_count;
+        /// Offsets of the regions from the beginning of the file and its whole size.
+        uint64_t slots_offset;
+        uint64_t values_offset;
+        uint64_t file_size;
+    };
+
+    /// Slot of the table. Rev_pos is the index of the element, EMPTY or DELETED, next is the position of the next slot
+    /// in chain or NO_NEXT.
+    template <class SlotIndex>
+    struct Slot {
+        SlotIndex rev_pos;
+        SlotIndex next;
+
+        static constexpr SlotIndex EMPTY = -1;
+        static constexpr SlotIndex DELETED = -2;
+        static constexpr SlotIndex NO_NEXT = -1;
+    };
+
+    /// Bytes "HAMSNAP" in the little-endian order.
+    static constexpr uint64_t MAGIC = 0x0050414E534D4148ull;
+    /// Version of the format, it changes with any change of the layout.
+    static constexpr uint32_t VERSION = 1;
+    /// Alignment of the regions, the cache line.
+    static constexpr uint64_t ALIGNMENT = 64;
+
+    /// Returns the offset rounded up to ALIGNMENT.
+    static uint64_t Align(uint64_t offset) {
+        return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+    }
+};
+
+/// Hash map is an associative container that contains key-value pairs with unique keys. Search, insertion, and removal
+/// of elements have average constant-time complexity. A strategy of collision resolution is coalesced hashing with the
+/// cellar. Storage is the policy of keeping the elements: ListStorage, DenseStorage or SplitStorage. GrowPolicy chooses
+/// sizes of the table and maps hashes to slots: PrimeGrowPolicy, PowerOfTwoGrowPolicy or FastRangeGrowPolicy.
+/// HashCache chooses what part of the hash is kept in slots: NoHashCache, FullHashCache or TruncatedHashCache. If both
+/// Hash and Equal have is_transparent member type, then lookups accept any key type they support without constructing
+/// Key. SlotIndex is the unsigned type of indices kept in slots, uint32_t gives the compact layout for tables with less
+/// than 2^32 slots. Allocator is rebound for the elements, the slots and the positions, PoolAllocator keeps the nodes
+/// in a pool. Stats is NoStats or CollectStats, the latter counts the probes and the rebuilds for stats(). Maps of
+/// untrusted keys should use SeededHash or wrap a weak hasher into MixedHash, so that the keys can't be chosen to
+/// collide.
+template <class Key, class T, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>,
+          class Storage = ListStorage, class GrowPolicy = PrimeGrowPolicy, class HashCache = NoHashCache,
+          class SlotIndex = size_t, class Allocator = std::allocator<std::pair<const Key, T>>, class Stats = NoStats>
+class HashMap {
+    /// Enables lookups by the compatible key K, if both Hash and Equal are transparent. The condition is made dependent
+    /// on K, so that the overloads are discarded by substitution failure.
+    template <class K>
+    using EnableIfTransparent =
+        std::enable_if_t<IsTransparent<Hash>::value && IsTransparent<Equal>::value && std::is_same_v<K, K>>;
+
+public:
+    /// Public typedefs:
+
+    using KeyType = Key;
+    using MappedType = T;
+    using ValueType = std::pair<const Key, T>;
+    using SizeType = size_t;
+    using Hasher = Hash;
+    using KeyEqual = Equal;
+    using AllocatorType = typename std::allocator_traits<Allocator>::template rebind_alloc<ValueType>;
+
+private:
+    using AllocatorTraits = std::allocator_traits<AllocatorType>;
+    using ValueContainer = typename Storage::template Container<ValueType, AllocatorType>;
+
+public:
+    /// Since values are contained in the storage, its iterators are used. Iterator-related typedefs:
+
+    using iterator = typename ValueContainer::iterator;              // NOLINT
+    using const_iterator = typename ValueContainer::const_iterator;  // NOLINT
+
+    /// Default constructor creates no elements.
+    explicit HashMap(const Hasher &hf = Hasher(), const KeyEqual &eq = KeyEqual(),
+                     const AllocatorType &alloc = AllocatorType())
+        : values_(alloc),
+          positions_(PositionAllocator(alloc)),
+          data_(DataAllocator(alloc)),
+          hasher_(hf),
+          key_equal_(eq),
+          old_data_(DataAllocator(alloc)) {
+        Rehash(0);
+    }
+
+    /// Create an hash map consisting of copies of the elements from [first, last).
+    template <typename InputIterator>
+    HashMap(InputIterator first, InputIterator last, const Hasher &hf = Hasher(), const KeyEqual &eq = KeyEqual(),
+            const AllocatorType &alloc = AllocatorType())
+        : HashMap(hf, eq, alloc) {
+        using Category = typename std::iterator_traits<InputIterator>::iterator_category;
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, Category>) {
+            reserve(static_cast<SizeType>(std::distance(first, last)));
+        }
+        for (auto it = first; it != last; ++it) {
+            emplace(*it);
+        }
+    }
+
+    /// Create an hash map consisting of copies of the elements in the list.
+    HashMap(std::initializer_list<std::pair<KeyType, MappedType>> list, const Hasher &hf = Hasher(),
+            const KeyEqual &eq = KeyEqual(), const AllocatorType &alloc = AllocatorType())
+        : HashMap(hf, eq, alloc) {
+        reserve(list.size());
+        for (const auto &x : list) {
+            emplace(x);
+        }
+    }
+
+    /// Copy constructor. The copy is a structural clone, see Clone.
+    HashMap(const HashMap &other)
+        : HashMap(other, AllocatorTraits::select_on_container_copy_construction(other.get_allocator())) {
+    }
+
+    /// Copy constructor with the given allocator.
+    HashMap(const HashMap &other, const AllocatorType &alloc)
+        : values_(alloc),
+          positions_(PositionAllocator(alloc)),
+          data_(DataAllocator(alloc)),
+          hasher_(other.hasher_),
+          key_equal_(other.key_equal_),
+          old_data_(DataAllocator(alloc)) {
+        Clone(other);
+    }
+
+    /// Move constructor. The tables and the elements are taken from the other hash map, which is left empty without
+    /// a table, so nothing is allocated. Its table is allocated by the first insertion.
+    HashMap(HashMap &&other) noexcept(std::is_nothrow_copy_constructible_v<Hasher> &&
+                                      std::is_nothrow_copy_constructible_v<KeyEqual>)
+        : values_(std::move(other.values_)),
+          positions_(std::move(other.positions_)),
+          data_(std::move(other.data_)),
+          hasher_(other.hasher_),
+          key_equal_(other.key_equal_),
+          old_data_(std::move(other.old_data_)),
+          stats_(other.stats_) {
+        CopyLayout(other);
+        other.ResetUnallocated();
+    }
+
+    /// Copy assignment operator. The allocator of other is taken, if it propagates on the copy assignment.
+    HashMap &operator=(const HashMap &other) {
+        if (this != &other) {
+            values_.clear();
+            if constexpr (AllocatorTraits::propagate_on_container_copy_assignment::value) {
+                /// Copying the empty vectors of the other allocator propagates it, the old memory is freed by the old
+                /// allocator.
+                const AllocatorType alloc = other.get_allocator();
+                const PositionVector positions{PositionAllocator(alloc)};
+                const DataVector data{DataAllocator(alloc)};
+                values_.Reset(alloc);
+                positions_ = positions;
+                data_ = data;
+                old_data_ = data;
+            }
+            Clone(other);
+        }
+        return *this;
+    }
+
+    /// Move assignment operator. The other hash map is left empty as by the move constructor. The allocator of other
+    /// is taken, if it propagates on the move assignment. Otherwise, if the allocators are not equal, the elements are
+    /// moved one by one into the memory of this allocator.
+    HashMap &operator=(HashMap &&other) noexcept((AllocatorTraits::propagate_on_container_move_assignment::value ||
+                                                  AllocatorTraits::is_always_equal::value) &&
+                                                 std::is_nothrow_copy_assignable_v<Hasher> &&
+                                                 std::is_nothrow_copy_assignable_v<KeyEqual>) {
+        if (this == &other) {
+            return *this;
+        }
+        if constexpr (AllocatorTraits::propagate_on_container_move_assignment::value ||
+                      AllocatorTraits::is_always_equal::value) {
+            /// The containers take the buffers and, if it propagates, the allocator of other.
+            values_ = std::move(other.values_);
+            positions_ = std::move(other.positions_);
+            data_ = std::move(other.data_);
+            old_data_ = std::move(other.old_data_);
+            hasher_ = other.hasher_;
+            key_equal_ = other.key_equal_;
+            stats_ = other.stats_;
+            CopyLayout(other);
+            other.ResetUnallocated();
+        } else if (get_allocator() == other.get_allocator()) {
+            /// The containers would move the elements one by one without propagation, so the equal allocators are
+            /// swapped with the buffers.
+            HashMap moved(std::move(other));
+            swap(moved);
+        } else {
+            clear();
+            hasher_ = other.hasher_;
+            key_equal_ = other.key_equal_;
+            max_load_factor_ = other.max_load_factor_;
+            cellar_fraction_ = other.cellar_fraction_;
+            local_placement_ = other.local_placement_;
+            rehash_step_ = other.rehash_step_;
+            build_threads_ = other.build_threads_;
+            Rehash(MinPrimarySize(other.size()));
+            for (auto &&x : other) {
+                try_emplace(x.first, std::move(x.second));
+            }
+            other.clear();
+        }
+        return *this;
+    }
+
+    /// Exchanges the contents with the other hash map.
+    void swap(HashMap &other) {
+        values_.Swap(other.values_);
+        positions_.swap(other.positions_);
+        data_.swap(other.data_);
+        std::swap(element_count_, other.element_count_);
+        std::swap(primary_size_, other.primary_size_);
+        std::swap(cellar_size_, other.cellar_size_);
+        std::swap(start_pos_, other.start_pos_);
+        std::swap(max_lookups_, other.max_lookups_);
+        std::swap(deleted_count_, other.deleted_count_);
+        std::swap(max_element_count_, other.max_element_count_);
+        std::swap(max_load_factor_, other.max_load_factor_);
+        std::swap(cellar_fraction_, other.cellar_fraction_);
+        std::swap(local_placement_, other.local_placement_);
+        std::swap(hasher_, other.hasher_);
+        std::swap(key_equal_, other.key_equal_);
+        old_data_.swap(other.old_data_);
+        std::swap(old_primary_size_, other.old_primary_size_);
+        std::swap(old_count_, other.old_count_);
+        std::swap(migrate_pos_, other.migrate_pos_);
+        std::swap(rehash_step_, other.rehash_step_);
+        std::swap(current_tag_, other.current_tag_);
+        std::swap(build_threads_, other.build_threads_);
+        std::swap(generation_, other.generation_);
+        std::swap(stats_, other.stats_);
+    }
+
+    /// Returns the number of elements.
+    SizeType size() const {
+        return element_count_;
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Clears the contents. The capacity of the storage is kept. If SlotIndex has 64 bits, then the slots aren't
+    /// touched, the generation is advanced instead, and only once in 2^GENERATION_BITS calls the table is reset.
+    void clear() {
+        values_.clear();
+        if constexpr (Data::GENERATION_BITS > 0) {
+            generation_ = (generation_ + 1) & ((1ull << Data::GENERATION_BITS) - 1);
+            if (generation_ == 0) {
+                data_.assign(data_.size(), EmptySlot());
+            }
+        } else if (deleted_count_ == 0) {
+            for (auto id : positions_) {
+                Slot(id) = EmptySlot();
+            }
+        } else {
+            data_.assign(data_.size(), EmptySlot());
+        }
+        positions_.clear();
+        element_count_ = 0;
+        deleted_count_ = 0;
+        start_pos_ = primary_size_ + cellar_size_ - 1;
+        DropOldTable();
+    }
+
+    /// Rebuilds the table without growing it, so that no deleted slots are left in the chains.
+    void compact() {
+        Rehash(primary_size_);
+    }
+
+    /// Rebuilds the table so that its addressable part has at least n slots and the load factor doesn't exceed the
+    /// maximum one. The table may shrink.
+    void rehash(SizeType n) {
+        Rehash(std::max(n, MinPrimarySize(size())));
+    }
+
+    /// Makes the table large enough to contain n elements without growing.
+    void reserve(SizeType n) {
+        if (n > max_element_count_) {
+            Rehash(MinPrimarySize(n));
+        }
+    }
+
+    /// Shrinks the table and the storage of elements to the current number of elements.
+    void shrink_to_fit() {
+        rehash(0);
+        values_.ShrinkToFit();
+        positions_.shrink_to_fit();
+    }
+
+    /// Returns the number of elements per slot of the addressable part.
+    float load_factor() const {
+        return primary_size_ == 0 ? 0 : static_cast<float>(size()) / primary_size_;
+    }
+
+    /// Returns the load factor, after which the table grows.
+    float max_load_factor() const {
+        return max_load_factor_;
+    }
+
+    /// Sets the load factor in (0, 1], after which the table grows. The table is rebuilt, if it is loaded more.
+    void max_load_factor(float ml) {
+        if (!(ml > 0 && ml <= 1)) {
+            throw std::invalid_argument("HashMap::max_load_factor");
+        }
+        max_load_factor_ = ml;
+        if (size() > MaxElementCount(primary_size_)) {
+            rehash(0);
+        } else {
+            max_element_count_ = MaxElementCount(primary_size_);
+        }
+    }
+
+    /// Returns the ratio of the cellar size to the size of the addressable part.
+    float cellar_fraction() const {
+        return cellar_fraction_;
+    }
+
+    /// Sets the ratio of the cellar size to the size of the addressable part and rebuilds the table with it. A bigger
+    /// cellar takes more memory, but keeps the addressable part free for homes of the keys, so chains are shorter.
+    void cellar_fraction(float fraction) {
+        if (!(fraction >= 0)) {
+            throw std::invalid_argument("HashMap::cellar_fraction");
+        }
+        cellar_fraction_ = fraction;
+        Rehash(primary_size_);
+    }
+
+    /// Returns whether a collided key takes a free slot in the cache line of its chain's tail before the cellar.
+    bool local_placement() const {
+        return local_placement_;
+    }
+
+    /// Sets whether a collided key takes a free slot in the cache line of its chain's tail before the cellar. Both the
+    /// cellar scan and the chains of collisions from unrelated homes interleave slots across the whole table, so every
+    /// hop of a lookup is a cache miss. Local slots keep the hops in the line, that the lookup has already loaded, at
+    /// the cost of earlier coalescing, when a later key hashes to the taken slot. The cellar is then used only by
+    /// chains, whose line is full, so a small cellar_fraction() saves memory. It applies to the next placements.
+    void local_placement(bool enabled) {
+        local_placement_ = enabled;
+    }
+
+    /// Inserts elements. Returns iterator to the element with the key and whether the insertion took place.
+    std::pair<iterator, bool> insert(const ValueType &x) {
+        return try_emplace(x.first, x.second);
+    }
+
+    /// Inserts elements. Returns iterator to the element with the key and whether the insertion took place.
+    std::pair<iterator, bool> insert(ValueType &&x) {
+        SizeType hash = hasher_(x.first);
+        SizeType id = Find(x.first, hash);
+        if (id != NONE) {
+            return {GetIterator(id), false};
+        }
+        values_.EmplaceBack(std::move(x));
+        return {GetIterator(Insert(hash)), true};
+    }
+
+    /// Constructs the element from args and inserts it, if there is no element with its key. Returns iterator to the
+    /// element with the key and whether the insertion took place.
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args &&...args) {
+        /// The key is known only after the construction, so the element is constructed at the end of values_ and is
+        /// removed, if the key exists or its lookup throws.
+        values_.EmplaceBack(std::forward<Args>(args)...);
+        SizeType hash, id;
+        try {
+            const KeyType &key = values_.Back().first;
+            hash = hasher_(key);
+            id = Find(key, hash);
+        } catch (...) {
+            values_.PopBack();
+            throw;
+        }
+        if (id != NONE) {
+            values_.PopBack();
+            return {GetIterator(id), false};
+        }
+        return {GetIterator(Insert(hash)), true};
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with the key. Otherwise
+    /// nothing is constructed. Returns iterator to the element with the key and whether the insertion took place.
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType &key, Args &&...args) {
+        return TryEmplace(key, std::forward<Args>(args)...);
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with the key. Otherwise
+    /// nothing is constructed. Returns iterator to the element with the key and whether the insertion took place.
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType &&key, Args &&...args) {
+        return TryEmplace(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with an equal key.
+    /// Key is constructed from the compatible key only when the insertion takes place.
+    template <class K, class... Args, class = EnableIfTransparent<K>>
+    std::pair<iterator, bool> try_emplace(K &&key, Args &&...args) {
+        return TryEmplace(std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    /// Erases elements.
+    void erase(const KeyType &key) {
+        Erase(key);
+    }
+
+    /// Erases elements with a key equal to the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    void erase(const K &key) {
+        Erase(key);
+    }
+
+    /// Access specified element with bounds checking.
+    const MappedType &at(const KeyType &key) const {
+        return At(key);
+    }
+
+    /// Access specified element with bounds checking by the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    const MappedType &at(const K &key) const {
+        return At(key);
+    }
+
+    /// Access or insert specified element.
+    MappedType &operator[](const KeyType &key) {
+        return try_emplace(key).first->second;
+    }
+
+    /// Access or insert specified element.
+    MappedType &operator[](KeyType &&key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    /// Access or insert specified element by the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    MappedType &operator[](K &&key) {
+        return try_emplace(std::forward<K>(key)).first->second;
+    }
+
+    /// Finds element with specific key.
+    iterator find(const KeyType &key) {
+        return FindIterator(key);
+    }
+
+    /// Finds element with specific key.
+    const_iterator find(const KeyType &key) const {
+        return FindIterator(key);
+    }
+
+    /// Finds element with a key equal to the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    iterator find(const K &key) {
+        return FindIterator(key);
+    }
+
+    /// Finds element with a key equal to the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    const_iterator find(const K &key) const {
+        return FindIterator(key);
+    }
+
+    /// Finds elements with the keys from [first, last) and writes iterators to them, or end() for missing keys, to out.
+    /// Keys are taken in blocks: the hashes of a block are computed and its home slots and elements are prefetched
+    /// before the chains are walked, so that cache misses of different keys overlap. Keys should be KeyType, or any
+    /// compatible type if both Hash and Equal are transparent.
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator find_batch(ForwardIterator first, ForwardIterator last, OutputIterator out) {
+        FindBatch(first, last, [&](SizeType id) { *out++ = id == NONE ? end() : GetIterator(id); });
+        return out;
+    }
+
+    /// Finds elements with the keys from [first, last) and writes iterators to them, or end() for missing keys, to out.
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator find_batch(ForwardIterator first, ForwardIterator last, OutputIterator out) const {
+        FindBatch(first, last, [&](SizeType id) { *out++ = id == NONE ? end() : GetIterator(id); });
+        return out;
+    }
+
+    /// Writes to out whether each of the keys from [first, last) is in the hash map.
+    template <class ForwardIterator, class OutputIterator>
+    OutputIterator contains_batch(ForwardIterator first, ForwardIterator last, OutputIterator out) const {
+        FindBatch(first, last, [&](SizeType id) { *out++ = id != NONE; });
+        return out;
+    }
+
+    /// Inserts the elements from [first, last), whose keys don't exist. The table is reserved for all of them at once,
+    /// and as in find_batch the hashes and home slots of a block are prepared before its elements are inserted.
+    template <class ForwardIterator>
+    void insert_batch(ForwardIterator first, ForwardIterator last) {
+        reserve(size() + static_cast<SizeType>(std::distance(first, last)));
+        SizeType hashes[BATCH_SIZE];
+        while (first != last) {
+            ForwardIterator block = first;
+            SizeType count = 0;
+            for (; first != last && count < BATCH_SIZE; ++first, ++count) {
+                hashes[count] = hasher_(first->first);
+                Prefetch(&data_[GrowPolicy::Index(hashes[count], primary_size_)]);
+            }
+            for (SizeType i = 0; i < count; ++i, ++block) {
+                if (Find(block->first, hashes[i]) == NONE) {
+                    values_.EmplaceBack(*block);
+                    Insert(hashes[i]);
+                }
+            }
+        }
+    }
+
+    /// Inserts the elements from [first, last) as insert_batch does, but takes their hashes from the range beginning
+    /// at hashes instead of calling the hasher, so the keys may be hashed beforehand by other threads. The hashes must
+    /// be those hash_function() gives. A range of move iterators moves the elements into the map.
+    template <class ForwardIterator, class HashIterator>
+    void insert_batch(ForwardIterator first, ForwardIterator last, HashIterator hashes) {
+        reserve(size() + static_cast<SizeType>(std::distance(first, last)));
+        while (first != last) {
+            ForwardIterator block = first;
+            HashIterator block_hashes = hashes;
+            for (SizeType count = 0; first != last && count < BATCH_SIZE; ++first, ++hashes, ++count) {
+                Prefetch(&data_[GrowPolicy::Index(*hashes, primary_size_)]);
+            }
+            for (; block != first; ++block, ++block_hashes) {
+                if (Find(block->first, *block_hashes) == NONE) {
+                    values_.EmplaceBack(*block);
+                    Insert(*block_hashes);
+                }
+            }
+        }
+    }
+
+    /// Moves the element to the end of the iteration order without a lookup, iterators and references stay valid. So
+    /// the order may keep the recency of the elements, as LruCache does. Only ListStorage supports it.
+    void move_to_back(const_iterator it) {
+        values_.MoveToBack(it);
+    }
+
+    /// Returns a read/write iterator that points to the first element in the hash map.
+    iterator begin() {
+        return values_.begin();
+    }
+
+    /// Returns a read/write iterator that points one past the last element in the hash map.
+    iterator end() {
+        return values_.end();
+    }
+
+    /// Returns a read-only (constant) iterator that points to the first element in the hash map.
+    const_iterator begin() const {
+        return values_.begin();
+    }
+
+    /// Returns a read-only (constant) iterator that points one past the last element in the hash map.
+    const_iterator end() const {
+        return values_.end();
+    }
+
+    /// Returns function used to hash the keys.
+    Hasher hash_function() const {
+        return hasher_;
+    }
+
+    /// Returns the allocator of the elements.
+    AllocatorType get_allocator() const {
+        return AllocatorType(positions_.get_allocator());
+    }
+
+    /// Returns function used to compare the keys for equality.
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+    /// Returns the number of elements moved per mutating operation during the incremental rehash.
+    SizeType rehash_step() const {
+        return rehash_step_;
+    }
+
+    /// Enables the incremental rehash. When an insertion grows the table, rebuilds it for too many deleted slots or
+    /// for a too long chain, the old table stays alive and at most step elements are moved from it to the new one per
+    /// insertion or removal, lookups check both tables until the migration finishes. A rebuild during the migration
+    /// finishes it at once, and so do rehash, reserve, compact and the other explicit rebuilds. Zero disables it, then
+    /// the whole table is rebuilt at once.
+    void rehash_step(SizeType step) {
+        rehash_step_ = step;
+        if (step == 0) {
+            Migrate(NONE);
+        }
+    }
+
+    /// Returns the number of threads used by insert_bulk and by the rebuilds of large tables.
+    SizeType build_threads() const {
+        return build_threads_;
+    }
+
+    /// Sets the number of threads used by insert_bulk and by the rebuilds of tables with at least PARALLEL_MIN_SIZE
+    /// elements. Zero means one thread per hardware thread, one disables the parallel rebuild.
+    void build_threads(SizeType threads) {
+        build_threads_ = threads;
+    }
+
+    /// Inserts the elements from [first, last), whose keys don't exist, and rebuilds the table for all of them at once
+    /// by build_threads() threads. Of the equal keys the first one is kept. Hash and Equal are called concurrently.
+    template <class ForwardIterator>
+    void insert_bulk(ForwardIterator first, ForwardIterator last) {
+        Migrate(NONE);
+        SizeType old_size = size();
+        std::vector<Link> links(old_size);
+        for (SizeType i = 0; i < old_size; ++i) {
+            links[i] = data_[positions_[i] & ~TABLE_BIT];
+        }
+        try {
+            for (auto it = first; it != last; ++it) {
+                values_.EmplaceBack(*it);
+                links.push_back(values_.GetLink(std::prev(values_.end())));
+            }
+            CountRebuild([&] { BulkRehash(std::max(primary_size_, MinPrimarySize(links.size())), links, old_size); });
+        } catch (...) {
+            while (values_.size() > old_size) {
+                values_.PopBack();
+            }
+            throw;
+        }
+    }
+
+    /// Writes the table and the elements in SnapshotFormat, which FrozenHashMap serves from the mapped file without
+    /// deserialization. Both Key and T must be trivially copyable. The slots keep their chains, so the snapshot has the
+    /// same lookup cost as the map, and iteration order of the snapshot is the order of the element indices.
+    void write_snapshot(std::ostream &out) const {
+        static_assert(std::is_trivially_copyable_v<Key> && std::is_trivially_copyable_v<T>,
+                      "snapshot needs trivially copyable keys and values");
+        static_assert(alignof(ValueType) <= SnapshotFormat::ALIGNMENT, "snapshot can't align the elements");
+        if (!old_data_.empty()) {
+            /// The migration of the copy is finished, so it has a single table.
+            HashMap copy(*this);
+            copy.Migrate(NONE);
+            copy.write_snapshot(out);
+            return;
+        }
+        if (data_.empty()) {
+            /// A moved-from map has no table, the snapshot gets the table of an empty map.
+            HashMap(hasher_, key_equal_).write_snapshot(out);
+            return;
+        }
+        using FileSlot = SnapshotFormat::Slot<SlotIndex>;
+        SnapshotFormat::Header header{};
+        header.magic = SnapshotFormat::MAGIC;
+        header.version = SnapshotFormat::VERSION;
+        header.grow_policy = GrowPolicy::ID;
+        header.hash_seed = HashSeed<Hasher>::Get(hasher_);
+        header.slot_index_size = sizeof(SlotIndex);
+        header.key_size = sizeof(Key);
+        header.mapped_size = sizeof(T);
+        header.value_size = sizeof(ValueType);
+        header.primary_size = primary_size_;
+        header.table_size = data_.size();
+        header.element_count = element_count_;
+        header.slots_offset = SnapshotFormat::Align(sizeof(header));
+        header.values_offset = SnapshotFormat::Align(header.slots_offset + data_.size() * sizeof(FileSlot));
+        header.file_size = header.values_offset + element_count_ * sizeof(ValueType);
+
+        std::vector<char> buffer(reinterpret_cast<const char *>(&header),
+                                 reinterpret_cast<const char *>(&header) + sizeof(header));
+        buffer.resize(header.slots_offset);
+        /// Regions are written through the buffer by chunks.
+        auto append = [&buffer, &out](const void *bytes, SizeType size) {
+            buffer.insert(buffer.end(), static_cast<const char *>(bytes), static_cast<const char *>(bytes) + size);
+            if (buffer.size() >= SNAPSHOT_CHUNK) {
+                out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+                buffer.clear();
+            }
+        };
+        for (const auto &slot : data_) {
+            FileSlot file_slot{FileSlot::EMPTY, FileSlot::NO_NEXT};
+            if (!Stale(slot) && !slot.Empty()) {
+                file_slot.rev_pos = slot.rev_pos;
+                if (slot.Next() != NONE) {
+                    file_slot.next = static_cast<SlotIndex>(slot.Next());
+                }
+            }
+            append(&file_slot, sizeof(file_slot));
+        }
+        static constexpr char PADDING[SnapshotFormat::ALIGNMENT] = {};
+        append(PADDING, header.values_offset - header.slots_offset - data_.size() * sizeof(FileSlot));
+        for (SizeType id : positions_) {
+            /// The pair of references of SplitStorage is copied into the element here.
+            const ValueType &x = Value(id);
+            append(&x, sizeof(ValueType));
+        }
+        out.write(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+        if (!out) {
+            throw std::runtime_error("HashMap: snapshot write failed");
+        }
+    }
+
+    /// Returns the statistics of the map. The counters of events are collected only with the CollectStats policy, the
+    /// structure of the current table is measured by the call in time linear in the table size.
+    HashMapStats stats() const {
+        HashMapStats stats;
+        if constexpr (Stats::ENABLED) {
+            stats_.CopyTo(stats);
+        }
+        SizeType total_length = 0;
+        for (SizeType pos = 0; pos < data_.size(); ++pos) {
+            const Data &slot = data_[pos];
+            if (Stale(slot) || slot.Empty()) {
+                continue;
+            }
+            if (pos >= primary_size_ && slot.Used()) {
+                ++stats.cellar_used;
+            }
+            if (slot.Linked()) {
+                continue;
+            }
+            SizeType length = 1;
+            for (SizeType next = slot.Next(); next != NONE; next = data_[next].Next()) {
+                ++length;
+            }
+            ++stats.chain_count;
+            total_length += length;
+            stats.max_chain_length = std::max(stats.max_chain_length, length);
+        }
+        if (stats.chain_count != 0) {
+            stats.average_chain_length = static_cast<double>(total_length) / static_cast<double>(stats.chain_count);
+        }
+        stats.cellar_size = cellar_size_;
+        stats.deleted_count = deleted_count_;
+        return stats;
+    }
+
+private:
+    using Link = typename ValueContainer::Link;
+
+    /// Information stored in a slot. Whether the slot is used or deleted is encoded by the reserved values of rev_pos,
+    /// and the highest bit of next tells whether some slot links to this one. So no separate flags are needed. If
+    /// SlotIndex has 64 bits, the next GENERATION_BITS bits of next keep the generation of the slot, slots of the older
+    /// generations are empty whatever they contain, so clear() doesn't touch them.
+    ///
+    /// Every slot has at most one predecessor, and empty slots have neither predecessor nor successor, so chains never
+    /// loop. Deleted slots stay in their chains and are reused only by insertions that walk to them.
+    struct Data : Link, HashCache::Field {
+        SlotIndex rev_pos;
+        SlotIndex next;
+        Data() : HashCache::Field(), rev_pos(EMPTY), next(NO_NEXT){};
+
+        bool Used() const {
+            return rev_pos < DELETED;
+        }
+
+        bool Deleted() const {
+            return rev_pos == DELETED;
+        }
+
+        bool Empty() const {
+            return rev_pos == EMPTY;
+        }
+
+        /// Returns the link to the next slot in chain or NONE.
+        SizeType Next() const {
+            SlotIndex pos = next & NO_NEXT;
+            return pos == NO_NEXT ? NONE : pos;
+        }
+
+        void SetNext(SizeType pos) {
+            next = static_cast<SlotIndex>(next & ~NO_NEXT) | (pos == NONE ? NO_NEXT : static_cast<SlotIndex>(pos));
+        }
+
+        /// Whether some slot links to this one.
+        bool Linked() const {
+            return (next & LINKED) != 0;
+        }
+
+        void SetLinked(bool linked) {
+            next = linked ? static_cast<SlotIndex>(next | LINKED) : static_cast<SlotIndex>(next & ~LINKED);
+        }
+
+        SizeType Generation() const {
+            return (next & GENERATION_MASK) >> GENERATION_SHIFT;
+        }
+
+        void SetGeneration(SizeType generation) {
+            next = static_cast<SlotIndex>(next & ~GENERATION_MASK) |
+                   static_cast<SlotIndex>(static_cast<SlotIndex>(generation) << GENERATION_SHIFT);
+        }
+
+        /// Makes the slot deleted, it stays in its chain.
+        void Remove() {
+            static_cast<Link &>(*this) = Link();
+            rev_pos = DELETED;
+        }
+
+        /// Reserved values of rev_pos and next.
+        static constexpr SlotIndex EMPTY = -1;
+        static constexpr SlotIndex DELETED = -2;
+        static constexpr SizeType GENERATION_BITS = sizeof(SlotIndex) >= sizeof(uint64_t) ? 8 : 0;
+        static constexpr SlotIndex NO_NEXT = static_cast<SlotIndex>(-1) >> (GENERATION_BITS + 1);
+        static constexpr SlotIndex LINKED = static_cast<SlotIndex>(~(static_cast<SlotIndex>(-1) >> 1u));
+        static constexpr SlotIndex GENERATION_MASK = static_cast<SlotIndex>(~(NO_NEXT | LINKED));
+        static constexpr SizeType GENERATION_SHIFT = sizeof(SlotIndex) * 8 - 1 - GENERATION_BITS;
+    };
+
+    static_assert(std::is_unsigned_v<SlotIndex>, "SlotIndex must be an unsigned integer type");
+
+    using DataAllocator = typename AllocatorTraits::template rebind_alloc<Data>;
+    using PositionAllocator = typename AllocatorTraits::template rebind_alloc<SizeType>;
+    using DataVector = std::vector<Data, DataAllocator>;
+    using PositionVector = std::vector<SizeType, PositionAllocator>;
+
+    /// Slots are identified by the position tagged with TABLE_BIT of their table. The bit of the current table is
+    /// current_tag_, so when the migration starts, the identifiers kept in positions_ refer to the old table as is.
+
+    /// Returns the slot by its identifier.
+    Data &Slot(SizeType id) {
+        return (id & TABLE_BIT) == current_tag_ ? data_[id & ~TABLE_BIT] : old_data_[id & ~TABLE_BIT];
+    }
+
+    /// Returns the slot by its identifier.
+    const Data &Slot(SizeType id) const {
+        return (id & TABLE_BIT) == current_tag_ ? data_[id & ~TABLE_BIT] : old_data_[id & ~TABLE_BIT];
+    }
+
+    /// Returns the element stored in the used slot.
+    typename ValueContainer::Reference Value(SizeType id) {
+        Data &slot = Slot(id);
+        return values_.Get(slot, slot.rev_pos);
+    }
+
+    /// Returns the element stored in the used slot.
+    typename ValueContainer::ConstReference Value(SizeType id) const {
+        const Data &slot = Slot(id);
+        return values_.Get(slot, slot.rev_pos);
+    }
+
+    /// Inserts the element constructed from the key and args, if there is no element with an equal key.
+    template <class K, class... Args>
+    std::pair<iterator, bool> TryEmplace(K &&key, Args &&...args) {
+        SizeType hash = hasher_(key);
+        SizeType id = Find(key, hash);
+        if (id != NONE) {
+            return {GetIterator(id), false};
+        }
+        values_.EmplaceBack(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(key)),
+                            std::forward_as_tuple(std::forward<Args>(args)...));
+        return {GetIterator(Insert(hash)), true};
+    }
+
+    /// Erases the element with a key equal to the given one.
+    template <class K>
+    void Erase(const K &key) {
+        if (data_.empty()) {
+            return;
+        }
+        SizeType hash = hasher_(key);
+        SizeType prev;
+        SizeType pos = FindIn(data_, key, hash, GrowPolicy::Index(hash, primary_size_), prev);
+        if (pos != NONE) {
+            RemoveElement(data_[pos]);
+            Unlink(pos, prev);
+        } else if (!old_data_.empty()) {
+            pos = FindIn(old_data_, key, hash, GrowPolicy::Index(hash, old_primary_size_), prev);
+            if (pos == NONE) {
+                return;
+            }
+            /// The old table only shrinks, so its slot just becomes deleted.
+            RemoveElement(old_data_[pos]);
+            old_data_[pos].Remove();
+            if (--old_count_ == 0) {
+                DropOldTable();
+            }
+        } else {
+            return;
+        }
+        Migrate(rehash_step_);
+    }
+
+    /// Removes the element of the used slot from values_ and positions_. The slot itself is left as is.
+    void RemoveElement(const Data &slot) {
+        Slot(positions_.back()).rev_pos = slot.rev_pos;
+        std::swap(positions_[slot.rev_pos], positions_.back());
+        positions_.pop_back();
+        values_.Erase(slot, slot.rev_pos);
+        --element_count_;
+    }
+
+    /// Frees the slot of the current table, whose element is removed, keeping every other element reachable from its
+    /// home. The elements further in the chain that hash to the freed slot are moved up into it one by one, and then
+    /// the last vacated slot is cut out of the chain. Prev is the predecessor of the slot, if it is known, or NONE. If
+    /// the slot has a predecessor, that isn't known, the slot becomes deleted instead.
+    void Unlink(SizeType pos, SizeType prev) {
+        while (true) {
+            SizeType before = pos;
+            SizeType next = data_[pos].Next();
+            SizeType hash = 0;
+            while (next != NONE) {
+                if (data_[next].Used()) {
+                    hash = GetHash(data_[next]);
+                    if (GrowPolicy::Index(hash, primary_size_) == pos) {
+                        break;
+                    }
+                }
+                before = next;
+                next = data_[next].Next();
+            }
+            if (next == NONE) {
+                break;
+            }
+            Fill(pos, data_[next], data_[next].rev_pos, hash);
+            positions_[data_[pos].rev_pos] = pos | current_tag_;
+            prev = before;
+            pos = next;
+        }
+
+        SizeType next = data_[pos].Next();
+        if (prev != NONE) {
+            data_[prev].SetNext(next);
+        } else if (!data_[pos].Linked()) {
+            if (next != NONE) {
+                data_[next].SetLinked(false);
+            }
+        } else {
+            data_[pos].Remove();
+            ++deleted_count_;
+            return;
+        }
+        data_[pos] = EmptySlot();
+        /// The slot can be given to a chain again.
+        start_pos_ = std::max(start_pos_, pos);
+    }
+
+    /// Returns the mapped value of the element with a key equal to the given one.
+    template <class K>
+    const MappedType &At(const K &key) const {
+        auto it = FindIterator(key);
+        if (it == end()) {
+            throw std::out_of_range("_Map_base::at");
+        }
+        return it->second;
+    }
+
+    /// Finds the element with a key equal to the given one.
+    template <class K>
+    iterator FindIterator(const K &key) {
+        SizeType id = Find(key, hasher_(key));
+        if (id == NONE) {
+            return end();
+        }
+        return GetIterator(id);
+    }
+
+    /// Finds the element with a key equal to the given one.
+    template <class K>
+    const_iterator FindIterator(const K &key) const {
+        SizeType id = Find(key, hasher_(key));
+        if (id == NONE) {
+            return end();
+        }
+        return GetIterator(id);
+    }
+
+    /// Returns iterator to the element stored in the used slot.
+    iterator GetIterator(SizeType id) {
+        const Data &slot = Slot(id);
+        return values_.Iterator(slot, slot.rev_pos);
+    }
+
+    /// Returns iterator to the element stored in the used slot.
+    const_iterator GetIterator(SizeType id) const {
+        const Data &slot = Slot(id);
+        return values_.Iterator(slot, slot.rev_pos);
+    }
+
+    /// Calls callback with identifier of the slot of every key from [first, last) or NONE. Keys pass a pipeline of
+    /// BATCH_SIZE keys: a key is hashed and its home slot is prefetched, half of the pipeline later the element of the
+    /// home slot is prefetched, and only at the end of the pipeline the chain is walked.
+    template <class ForwardIterator, class Callback>
+    void FindBatch(ForwardIterator first, ForwardIterator last, Callback callback) const {
+        if (data_.empty()) {
+            for (; first != last; ++first) {
+                callback(NONE);
+            }
+            return;
+        }
+        ForwardIterator keys[BATCH_SIZE];
+        SizeType hashes[BATCH_SIZE];
+        SizeType homes[BATCH_SIZE];
+        /// Numbers of the keys that are hashed, whose elements are prefetched and that are found.
+        SizeType hashed = 0, prefetched = 0, found = 0;
+        while (first != last || found != hashed) {
+            if (hashed - found == BATCH_SIZE || (first == last && found != prefetched)) {
+                SizeType i = found++ % BATCH_SIZE;
+                callback(Find(*keys[i], hashes[i]));
+            }
+            if (first != last) {
+                SizeType i = hashed++ % BATCH_SIZE;
+                keys[i] = first++;
+                hashes[i] = hasher_(*keys[i]);
+                homes[i] = GrowPolicy::Index(hashes[i], primary_size_);
+                Prefetch(&data_[homes[i]]);
+            }
+            if (prefetched != hashed && (hashed - prefetched > BATCH_SIZE / 2 || first == last)) {
+                const Data &slot = data_[homes[prefetched++ % BATCH_SIZE]];
+                if (!Stale(slot) && slot.Used()) {
+                    Prefetch(&values_.Get(slot, slot.rev_pos).first);
+                }
+            }
+        }
+    }
+
+    /// Hints the processor to load the memory at the address into the cache.
+    static void Prefetch(const void *address) {
+#if defined(__GNUC__) || defined(__clang__)
+        __builtin_prefetch(address);
+#else
+        (void)address;
+#endif
+    }
+
+    /// Returns identifier of the slot with the key or NONE, if it is not in the table.
+    template <class K>
+    SizeType Find(const K &key, SizeType hash) const {
+        if (data_.empty()) {
+            return NONE;
+        }
+        SizeType prev;
+        SizeType pos = FindIn(data_, key, hash, GrowPolicy::Index(hash, primary_size_), prev);
+        if (pos != NONE) {
+            return pos | current_tag_;
+        }
+        if (!old_data_.empty()) {
+            pos = FindIn(old_data_, key, hash, GrowPolicy::Index(hash, old_primary_size_), prev);
+            if (pos != NONE) {
+                return pos | (current_tag_ ^ TABLE_BIT);
+            }
+        }
+        return NONE;
+    }
+
+    /// Returns position of the key with the hash in the slots starting the search from pos or NONE, if it is not there.
+    /// Prev is set to the previous slot of the walk or NONE, if the key is in the first one.
+    template <class K>
+    SizeType FindIn(const DataVector &data, const K &key, SizeType hash, SizeType pos, SizeType &prev) const {
+        prev = NONE;
+        if (Stale(data[pos])) {
+            RecordLookup(1);
+            return NONE;
+        }
+        SizeType probes = 0;
+        while (true) {
+            if (pos == NONE) {
+                RecordLookup(probes);
+                return NONE;
+            }
+            ++probes;
+            if (data[pos].Used()) {
+                if (HashCache::Matches(data[pos], hash) &&
+                    key_equal_(values_.Get(data[pos], data[pos].rev_pos).first, key)) {
+                    RecordLookup(probes);
+                    return pos;
+                }
+            } else if (!data[pos].Deleted()) {
+                RecordLookup(probes);
+                return NONE;
+            }
+            /// Using link.
+            prev = pos;
+            pos = data[pos].Next();
+        }
+    }
+
+    /// Links the last element of values_, whose key doesn't exist in the table, and returns identifier of its slot. If
+    /// a rebuild of the table throws, the element is removed from values_, so no element is left without a slot.
+    SizeType Insert(SizeType hash) {
+        SizeType pos;
+        try {
+            Grow();
+            while ((pos = Place(hash, true)) == NONE) {
+                if constexpr (Stats::ENABLED) {
+                    ++stats_.long_probe_rehashes;
+                }
+                Resize(primary_size_ << 1ull);
+            }
+        } catch (...) {
+            values_.PopBack();
+            throw;
+        }
+
+        Fill(pos, values_.GetLink(std::prev(values_.end())), positions_.size(), hash);
+        positions_.push_back(pos | current_tag_);
+        ++element_count_;
+
+        return pos | current_tag_;
+    }
+
+    /// Grows or rebuilds the table, if it can't take one more element, and continues the migration.
+    void Grow() {
+        /// The position of the new element is reserved first, and the rebuilds keep the capacity of positions_, so
+        /// nothing throws after the slot of the element is taken.
+        if (positions_.size() == positions_.capacity()) {
+            positions_.reserve(std::max<SizeType>(positions_.size() << 1ull, 1));
+        }
+        /// If the new element makes load factor of the current table more than the maximum one, then grow the table.
+        if (element_count_ - old_count_ >= max_element_count_) {
+            if constexpr (Stats::ENABLED) {
+                ++stats_.load_factor_rehashes;
+            }
+            Resize(primary_size_ << 1ull);
+        } else if ((deleted_count_ << 1ull) > data_.size() - max_element_count_) {
+            /// Too many deleted slots are left, so rebuild the table of the same size. Half of the slots, that are not
+            /// needed for the elements, stay empty, so the search for an empty slot always succeeds.
+            if constexpr (Stats::ENABLED) {
+                ++stats_.deleted_slot_rehashes;
+            }
+            Resize(primary_size_);
+        }
+        Migrate(rehash_step_);
+    }
+
+    /// Rebuilds the table with primary_size_ at least n, at once or by the incremental migration, if it is enabled.
+    void Resize(SizeType n) {
+        if (rehash_step_ == 0) {
+            Rehash(n);
+        } else {
+            StartMigration(n);
+        }
+    }
+
+    /// Links a slot for the new key into the chain of its hash in the current table and returns its position. If
+    /// early_rehash is set and the chain is too long, returns NONE without changing the table.
+    SizeType Place(SizeType hash, bool early_rehash) {
+        SizeType pos = GrowPolicy::Index(hash, primary_size_);
+        Refresh(data_[pos]);
+        if (data_[pos].Used()) {
+            SizeType distance = 0;
+            while (data_[pos].Next() != NONE && !data_[pos].Deleted()) {
+                pos = data_[pos].Next();
+                ++distance;
+            }
+            if (data_[pos].Used()) {
+                /// Only an empty slot may be linked, otherwise the chains could merge into a loop.
+                SizeType next_free = local_placement_ ? FreeInLine(pos) : NONE;
+                if (next_free == NONE) {
+                    next_free = ScanFree(distance, early_rehash);
+                    if (next_free == NONE) {
+                        RecordInsert(distance + 1);
+                        return NONE;
+                    }
+                }
+                Refresh(data_[next_free]);
+                data_[pos].SetNext(next_free);
+                data_[next_free].SetLinked(true);
+                pos = next_free;
+            }
+            RecordInsert(distance + 1);
+        } else {
+            RecordInsert(1);
+        }
+        if (data_[pos].Deleted()) {
+            --deleted_count_;
+        }
+        return pos;
+    }
+
+    /// Returns an empty slot in the cache line of the slot at pos or NONE, if there is none.
+    SizeType FreeInLine(SizeType pos) const {
+        SizeType offset = reinterpret_cast<uintptr_t>(&data_[pos]) % CACHE_LINE;
+        SizeType first = pos - std::min(pos, offset / sizeof(Data));
+        SizeType last = std::min(pos + (CACHE_LINE - 1 - offset) / sizeof(Data), data_.size() - 1);
+        for (SizeType i = first; i <= last; ++i) {
+            if (Stale(data_[i]) || data_[i].Empty()) {
+                return i;
+            }
+        }
+        return NONE;
+    }
+
+    /// Scans down from start_pos_ for an empty slot and returns it, adding the passed slots to distance. If
+    /// early_rehash is set and the scan is too long, returns NONE.
+    SizeType ScanFree(SizeType &distance, bool early_rehash) {
+        SizeType next_free = start_pos_;
+        while (!Stale(data_[next_free]) && !data_[next_free].Empty()) {
+            if constexpr (Stats::ENABLED) {
+                ++stats_.cellar_scan_steps;
+            }
+            if (next_free == 0) {
+                next_free = primary_size_ + cellar_size_ - 1;
+            } else {
+                --next_free;
+            }
+            ++distance;
+            /// If distance is more than max lookups, then immediately rehash the table. Load factor should be
+            /// more than half of the maximum one in case of a bad hash function.
+            if (early_rehash && ((element_count_ - old_count_) << 1ull) > max_element_count_ &&
+                distance > max_lookups_) {
+                return NONE;
+            }
+        }
+        start_pos_ = next_free;
+        return next_free;
+    }
+
+    /// Counts the lookup, that visited the number of slots, in the statistics.
+    void RecordLookup(SizeType probes) const {
+        if constexpr (Stats::ENABLED) {
+            ++stats_.lookup_probes[std::min(probes, HashMapStats::PROBE_BUCKETS) - 1];
+        }
+    }
+
+    /// Counts the placement, that visited the number of slots, in the statistics.
+    void RecordInsert(SizeType probes) const {
+        if constexpr (Stats::ENABLED) {
+            ++stats_.insert_probes[std::min(probes, HashMapStats::PROBE_BUCKETS) - 1];
+        }
+    }
+
+    /// Whether the slot is left from a generation before the last clear(), then it is empty whatever it contains.
+    bool Stale(const Data &slot) const {
+        return slot.Generation() != generation_;
+    }
+
+    /// Makes the stale slot really empty.
+    void Refresh(Data &slot) const {
+        if (Stale(slot)) {
+            slot = EmptySlot();
+        }
+    }
+
+    /// Returns an empty slot of the current generation.
+    Data EmptySlot() const {
+        Data slot;
+        slot.SetGeneration(generation_);
+        return slot;
+    }
+
+    /// Makes the slot of the current table refer to the element with the hash.
+    void Fill(SizeType pos, const Link &link, SizeType rev_pos, SizeType hash) {
+        static_cast<Link &>(data_[pos]) = link;
+        HashCache::Store(data_[pos], hash);
+        data_[pos].rev_pos = static_cast<SlotIndex>(rev_pos);
+    }
+
+    /// Makes this map with no elements a copy of other. The tables and the positions are copied as they are, with the
+    /// chains and an unfinished migration, and the elements once, so no key is hashed and no chain is walked. Links of
+    /// the slots are moved to the copied elements by the storage. The counters of the statistics start from zero.
+    void Clone(const HashMap &other) {
+        CopyLayout(other);
+        hasher_ = other.hasher_;
+        key_equal_ = other.key_equal_;
+        stats_ = typename Stats::Counters();
+        /// Assign with iterators keeps the allocators of the vectors.
+        positions_.assign(other.positions_.begin(), other.positions_.end());
+        data_.assign(other.data_.begin(), other.data_.end());
+        old_data_.assign(other.old_data_.begin(), other.old_data_.end());
+        try {
+            values_.CopyFrom(other.values_, [this](SizeType i) -> Link & { return Slot(positions_[i]); });
+        } catch (...) {
+            /// The slots of the elements, that aren't copied, refer to the elements of other, so the table is reset.
+            values_.clear();
+            positions_.clear();
+            data_.assign(data_.size(), EmptySlot());
+            element_count_ = 0;
+            deleted_count_ = 0;
+            start_pos_ = primary_size_ + cellar_size_ - 1;
+            DropOldTable();
+            throw;
+        }
+    }
+
+    /// Copies the sizes and the counts of the tables, the state of the migration and the settings of other, which go
+    /// with its tables.
+    void CopyLayout(const HashMap &other) noexcept {
+        element_count_ = other.element_count_;
+        primary_size_ = other.primary_size_;
+        cellar_size_ = other.cellar_size_;
+        start_pos_ = other.start_pos_;
+        max_lookups_ = other.max_lookups_;
+        deleted_count_ = other.deleted_count_;
+        max_element_count_ = other.max_element_count_;
+        max_load_factor_ = other.max_load_factor_;
+        cellar_fraction_ = other.cellar_fraction_;
+        local_placement_ = other.local_placement_;
+        old_primary_size_ = other.old_primary_size_;
+        old_count_ = other.old_count_;
+        migrate_pos_ = other.migrate_pos_;
+        rehash_step_ = other.rehash_step_;
+        current_tag_ = other.current_tag_;
+        build_threads_ = other.build_threads_;
+        generation_ = other.generation_;
+    }
+
+    /// Makes the current table the old one and starts the migration to the new table with primary_size_ at least n.
+    void StartMigration(SizeType n) {
+        if constexpr (Stats::ENABLED) {
+            ++stats_.rehash_count;
+        }
+        Migrate(NONE);
+        SizeType old_primary_size = primary_size_;
+        old_data_ = Allocate(n);
+        old_primary_size_ = old_primary_size;
+        old_count_ = element_count_;
+        migrate_pos_ = 0;
+        current_tag_ ^= TABLE_BIT;
+        if (old_count_ == 0) {
+            DropOldTable();
+        }
+    }
+
+    /// Moves at most count elements from the old table to the current one. Elements themselves stay in values_, only
+    /// their slots are relinked. Vacated slots of the old table become deleted, so its chains remain walkable.
+    void Migrate(SizeType count) {
+        for (; count > 0 && !old_data_.empty(); ++migrate_pos_) {
+            Data &old_slot = old_data_[migrate_pos_];
+            if (Stale(old_slot) || !old_slot.Used()) {
+                continue;
+            }
+            SizeType hash = GetHash(old_slot);
+            SizeType pos = Place(hash, false);
+            Fill(pos, old_slot, old_slot.rev_pos, hash);
+            positions_[old_slot.rev_pos] = pos | current_tag_;
+            old_slot.Remove();
+            --count;
+            if (--old_count_ == 0) {
+                DropOldTable();
+            }
+        }
+    }
+
+    /// Leaves the moved-from map empty without a table. Find returns NONE for any key, and the first insertion grows
+    /// the table from the empty one, since max_element_count_ is zero.
+    void ResetUnallocated() noexcept {
+        values_.clear();
+        positions_.clear();
+        data_.clear();
+        old_data_.clear();
+        element_count_ = 0;
+        primary_size_ = 0;
+        cellar_size_ = 0;
+        start_pos_ = NONE;
+        max_lookups_ = 0;
+        deleted_count_ = 0;
+        max_element_count_ = 0;
+        old_primary_size_ = 0;
+        old_count_ = 0;
+        migrate_pos_ = 0;
+        current_tag_ = 0;
+        generation_ = 0;
+    }
+
+    /// Frees the old table, when there is no migration or all its elements are moved.
+    void DropOldTable() {
+        DataVector(old_data_.get_allocator()).swap(old_data_);
+        old_count_ = 0;
+    }
+
+    /// Returns the number of elements, that the addressable part of the given size contains without growing.
+    SizeType MaxElementCount(SizeType primary_size) const {
+        return static_cast<SizeType>(primary_size * static_cast<double>(max_load_factor_));
+    }
+
+    /// Returns the minimum size of the addressable part, that contains n elements without growing.
+    SizeType MinPrimarySize(SizeType n) const {
+        return static_cast<SizeType>(std::ceil(n / static_cast<double>(max_load_factor_)));
+    }
+
+    /// Makes the current table empty with primary_size_ at least n and returns the previous one. Nothing is changed,
+    /// if it throws.
+    DataVector Allocate(SizeType n) {
+        SizeType primary_size = GrowPolicy::NextSize(n);
+        SizeType cellar_size = static_cast<SizeType>(primary_size * static_cast<double>(cellar_fraction_)) + 1;
+        /// Reserved values of SlotIndex can't be positions of slots or elements.
+        if (primary_size + cellar_size > Data::NO_NEXT) {
+            throw std::length_error("HashMap: too many slots for SlotIndex");
+        }
+        DataVector data(primary_size + cellar_size, EmptySlot(), data_.get_allocator());
+        data.swap(data_);
+        primary_size_ = primary_size;
+        cellar_size_ = cellar_size;
+        max_element_count_ = MaxElementCount(primary_size_);
+        start_pos_ = primary_size_ + cellar_size_ - 1;
+        /// Max lookups is log2 of primary_size_, but at least 4.
+        max_lookups_ = 0;
+        for (SizeType size = primary_size_; size != 0; size >>= 1ull) {
+            ++max_lookups_;
+        }
+        max_lookups_ = std::max<SizeType>(max_lookups_, 4);
+        deleted_count_ = 0;
+        return data;
+    }
+
+    /// Sizes and counters of the current table, that a rebuild changes.
+    struct TableSizes {
+        SizeType element_count;
+        SizeType primary_size;
+        SizeType cellar_size;
+        SizeType start_pos;
+        SizeType max_lookups;
+        SizeType deleted_count;
+        SizeType max_element_count;
+    };
+
+    TableSizes SaveSizes() const {
+        return {element_count_, primary_size_, cellar_size_, start_pos_, max_lookups_, deleted_count_,
+                max_element_count_};
+    }
+
+    /// Brings back the table of a failed rebuild with its sizes.
+    void RestoreTable(DataVector &old_data, const TableSizes &sizes) noexcept {
+        data_.swap(old_data);
+        element_count_ = sizes.element_count;
+        primary_size_ = sizes.primary_size;
+        cellar_size_ = sizes.cellar_size;
+        start_pos_ = sizes.start_pos;
+        max_lookups_ = sizes.max_lookups;
+        deleted_count_ = sizes.deleted_count;
+        max_element_count_ = sizes.max_element_count;
+    }
+
+    /// Returns the hash of the element in the used slot. It is taken from the slot, if the whole hash is stored there.
+    SizeType GetHash(const Data &slot) const {
+        if constexpr (HashCache::REUSABLE) {
+            return HashCache::Load(slot);
+        } else {
+            return hasher_(values_.Get(slot, slot.rev_pos).first);
+        }
+    }
+
+    /// Rebuilds the table so that the primary_size_ is at least n. Elements are neither copied nor moved, only the
+    /// slots are relinked to them, so iterators and references stay valid.
+    void Rehash(SizeType n) {
+        /// The first allocation of the constructor isn't a rebuild.
+        if (data_.empty()) {
+            Rebuild(n);
+        } else {
+            CountRebuild([&] { Rebuild(n); });
+        }
+    }
+
+    /// Calls build, that rebuilds the table, and counts the rebuild and its time in the statistics.
+    template <class F>
+    void CountRebuild(F build) {
+        if constexpr (Stats::ENABLED) {
+            auto start = std::chrono::steady_clock::now();
+            build();
+            ++stats_.rehash_count;
+            stats_.rehash_nanoseconds += static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start)
+                    .count());
+        } else {
+            build();
+        }
+    }
+
+    /// Rebuilds the table as Rehash describes without counting it.
+    void Rebuild(SizeType n) {
+        Migrate(NONE);
+        if (build_threads_ != 1 && size() >= PARALLEL_MIN_SIZE) {
+            std::vector<Link> links(size());
+            for (SizeType i = 0; i < size(); ++i) {
+                links[i] = data_[positions_[i] & ~TABLE_BIT];
+            }
+            BulkRehash(n, links, size());
+            return;
+        }
+        /// The keys are hashed and the positions are allocated before the table is touched, and the old table is kept
+        /// until the new one is built, so a throwing hasher or allocator leaves the map as it was.
+        std::vector<SizeType> hashes(HashCache::REUSABLE ? 0 : positions_.size());
+        for (SizeType i = 0; i < hashes.size(); ++i) {
+            hashes[i] = GetHash(data_[positions_[i] & ~TABLE_BIT]);
+        }
+        PositionVector positions = NewPositions(positions_.size());
+        TableSizes sizes = SaveSizes();
+        DataVector old_data = Allocate(n);
+        try {
+            while (!Relink(old_data, hashes, positions)) {
+                CountLongProbeRetry();
+                Allocate(primary_size_ << 1ull);
+            }
+        } catch (...) {
+            RestoreTable(old_data, sizes);
+            throw;
+        }
+        positions_.swap(positions);
+    }
+
+    /// Returns the positions of size elements for a rebuild. The capacity of positions_ is kept, so that the insertion,
+    /// which has reserved the position of its element, doesn't reallocate them after the rebuild.
+    PositionVector NewPositions(SizeType size) const {
+        PositionVector positions(positions_.get_allocator());
+        positions.reserve(std::max(size, positions_.capacity()));
+        positions.resize(size);
+        return positions;
+    }
+
+    /// Counts the retry of a rebuild with the larger table, since some chain was too long.
+    void CountLongProbeRetry() {
+        if constexpr (Stats::ENABLED) {
+            ++stats_.rehash_count;
+            ++stats_.long_probe_rehashes;
+        }
+    }
+
+    /// Links into the empty current table the elements from the old slots with the given hashes, unless the slots
+    /// keep them, writing their new identifiers to positions. Returns false, if some chain is too long and the table
+    /// should be bigger.
+    bool Relink(const DataVector &old_data, const std::vector<SizeType> &hashes, PositionVector &positions) {
+        element_count_ = 0;
+        for (SizeType i = 0; i < positions.size(); ++i) {
+            const Data &old_slot = old_data[positions_[i] & ~TABLE_BIT];
+            SizeType hash;
+            if constexpr (HashCache::REUSABLE) {
+                hash = GetHash(old_slot);
+            } else {
+                hash = hashes[i];
+            }
+            SizeType pos = Place(hash, true);
+            if (pos == NONE) {
+                return false;
+            }
+            Fill(pos, old_slot, i, hash);
+            positions[i] = pos | current_tag_;
+            ++element_count_;
+        }
+        return true;
+    }
+
+    /// Rebuilds the table with primary_size_ at least n in parallel for the elements of values_, whose links are given.
+    /// Elements since first_new have no slots yet, those of them whose keys exist before are removed from values_.
+    void BulkRehash(SizeType n, const std::vector<Link> &links, SizeType first_new) {
+        std::vector<SizeType> hashes(links.size());
+        ParallelFor(PartCount(links.size()), [&](SizeType part) {
+            auto [begin, end] = PartRange(part, links.size());
+            for (SizeType i = begin; i < end; ++i) {
+                if constexpr (HashCache::REUSABLE) {
+                    if (i < first_new) {
+                        hashes[i] = HashCache::Load(data_[positions_[i] & ~TABLE_BIT]);
+                        continue;
+                    }
+                }
+                hashes[i] = hasher_(values_.Get(links[i], i).first);
+            }
+        });
+        /// The old table is kept until the new one is built, so a throwing hasher, key_equal or allocator leaves the
+        /// table as it was.
+        PositionVector positions = NewPositions(links.size());
+        TableSizes sizes = SaveSizes();
+        DataVector old_data = Allocate(n);
+        try {
+            while (!BulkRelink(links, hashes, positions, first_new)) {
+                CountLongProbeRetry();
+                Allocate(primary_size_ << 1ull);
+            }
+        } catch (...) {
+            RestoreTable(old_data, sizes);
+            throw;
+        }
+        DataVector(old_data.get_allocator()).swap(old_data);
+        /// Removes the duplicates in the descending order, so that the last element, that takes the place of the
+        /// removed one, is always linked.
+        for (SizeType i = positions.size(); i-- > first_new;) {
+            if (positions[i] != NONE) {
+                continue;
+            }
+            SizeType last = positions.size() - 1;
+            values_.Erase(links[i], i);
+            if (i != last) {
+                positions[i] = positions[last];
+                Slot(positions[i]).rev_pos = static_cast<SlotIndex>(i);
+            }
+            positions.pop_back();
+        }
+        positions_.swap(positions);
+    }
+
+    /// Links the elements into the empty current table, writing their identifiers, or NONE for the duplicates, to
+    /// positions. Elements are split by their home slots into ranges of the addressable part, and every thread places
+    /// the elements of its range into their homes. The collided ones are linked after that by one thread, since the
+    /// chains and the cellar are shared. Returns false, if some chain is too long.
+    bool BulkRelink(const std::vector<Link> &links, const std::vector<SizeType> &hashes, PositionVector &positions,
+                    SizeType first_new) {
+        element_count_ = 0;
+        SizeType count = links.size();
+        SizeType threads = std::min(ThreadCount(), std::max<SizeType>(count, 1));
+        SizeType parts = PartCount(count);
+        std::vector<SizeType> homes(count);
+        /// Number of elements of every part in every range, and then the offsets of them in order.
+        std::vector<SizeType> offsets(parts * threads + 1);
+        ParallelFor(parts, [&](SizeType part) {
+            auto [begin, end] = PartRange(part, count);
+            for (SizeType i = begin; i < end; ++i) {
+                homes[i] = GrowPolicy::Index(hashes[i], primary_size_);
+                ++offsets[HomeRange(homes[i], threads) * parts + part + 1];
+            }
+        });
+        for (SizeType i = 1; i < offsets.size(); ++i) {
+            offsets[i] += offsets[i - 1];
+        }
+        /// Elements sorted by ranges, in every range they stay in their order.
+        std::vector<SizeType> order(count);
+        ParallelFor(parts, [&](SizeType part) {
+            auto [begin, end] = PartRange(part, count);
+            std::vector<SizeType> next(threads);
+            for (SizeType range = 0; range < threads; ++range) {
+                next[range] = offsets[range * parts + part];
+            }
+            for (SizeType i = begin; i < end; ++i) {
+                order[next[HomeRange(homes[i], threads)]++] = i;
+            }
+        });
+
+        std::vector<std::vector<SizeType>> collided(threads);
+        std::vector<SizeType> placed(threads);
+        ParallelFor(threads, [&](SizeType range) {
+            for (SizeType j = offsets[range * parts]; j < offsets[(range + 1) * parts]; ++j) {
+                SizeType i = order[j];
+                Data &home = data_[homes[i]];
+                if (home.Empty()) {
+                    Fill(homes[i], links[i], i, hashes[i]);
+                    positions[i] = homes[i] | current_tag_;
+                    ++placed[range];
+                } else if (i >= first_new && key_equal_(values_.Get(home, home.rev_pos).first,
+                                                        values_.Get(links[i], i).first)) {
+                    positions[i] = NONE;
+                } else {
+                    collided[range].push_back(i);
+                }
+            }
+        });
+        for (SizeType range = 0; range < threads; ++range) {
+            element_count_ += placed[range];
+        }
+
+        for (const auto &range : collided) {
+            for (SizeType i : range) {
+                SizeType prev;
+                if (i >= first_new &&
+                    FindIn(data_, values_.Get(links[i], i).first, hashes[i], homes[i], prev) != NONE) {
+                    positions[i] = NONE;
+                    continue;
+                }
+                SizeType pos = Place(hashes[i], true);
+                if (pos == NONE) {
+                    return false;
+                }
+                Fill(pos, links[i], i, hashes[i]);
+                positions[i] = pos | current_tag_;
+                ++element_count_;
+            }
+        }
+        return true;
+    }
+
+    /// Returns the number of threads of the parallel rebuild.
+    SizeType ThreadCount() const {
+        if (build_threads_ == 0) {
+            return std::max<SizeType>(std::thread::hardware_concurrency(), 1);
+        }
+        return build_threads_;
+    }
+
+    /// Returns the number of parts, into which count elements are split for the parallel processing.
+    SizeType PartCount(SizeType count) const {
+        return std::max<SizeType>(std::min(ThreadCount() << 2ull, count / PARALLEL_MIN_PART), 1);
+    }
+
+    /// Returns which of the equal ranges of the addressable part contains the home slot.
+    SizeType HomeRange(SizeType home, SizeType threads) const {
+        return home * threads / primary_size_;
+    }
+
+    /// Returns [begin, end) of indices of the part of count elements.
+    std::pair<SizeType, SizeType> PartRange(SizeType part, SizeType count) const {
+        SizeType parts = PartCount(count);
+        return {count * part / parts, count * (part + 1) / parts};
+    }
+
+    /// Calls f(part) for every part in [0, parts) by ThreadCount() threads, the current thread is one of them. The
+    /// started threads are joined, even if a thread can't be created or f throws, and then the first exception is
+    /// rethrown.
+    template <class F>
+    void ParallelFor(SizeType parts, F f) const {
+        SizeType threads = std::min(ThreadCount(), parts);
+        std::vector<std::exception_ptr> errors(threads);
+        auto work = [&](SizeType thread) {
+            try {
+                for (SizeType part = thread; part < parts; part += threads) {
+                    f(part);
+                }
+            } catch (...) {
+                errors[thread] = std::current_exception();
+            }
+        };
+        std::vector<std::thread> workers;
+        try {
+            workers.reserve(threads - 1);
+            for (SizeType thread = 1; thread < threads; ++thread) {
+                workers.emplace_back(work, thread);
+            }
+        } catch (...) {
+            errors[0] = std::current_exception();
+        }
+        if (!errors[0]) {
+            work(0);
+        }
+        for (auto &worker : workers) {
+            worker.join();
+        }
+        for (const auto &error : errors) {
+            if (error) {
+                std::rethrow_exception(error);
+            }
+        }
+    }
+
+    /// Private fields:
+
+    /// Values contained in the table.
+    ValueContainer values_;
+    /// Positions of the values in the table.
+    PositionVector positions_;
+    /// Slots of the table.
+    DataVector data_;
+    /// Number of elements in the table.
+    SizeType element_count_ = 0;
+    /// Size of the addressable part. Slots to which keys can hash to.
+    SizeType primary_size_ = 0;
+    /// Size of the cellar. Slots used when dealing with collisions.
+    SizeType cellar_size_ = 0;
+    /// Start position for searching slot to insert. Common it is always (primary_size_ + cellar_size_ - 1). Here it is
+    /// recalculated after insertion.
+    SizeType start_pos_ = 0;
+    /// Distance of the insertion probe, after which the table is rehashed immediately.
+    SizeType max_lookups_ = 0;
+    /// Number of deleted slots in the current table.
+    SizeType deleted_count_ = 0;
+    /// Number of elements in the current table, after which it grows.
+    SizeType max_element_count_ = 0;
+    /// Load factor, after which the table grows.
+    float max_load_factor_ = 0.5;
+    /// Ratio of the cellar size to the size of the addressable part.
+    float cellar_fraction_ = B;
+    /// Whether collided keys prefer free slots in the cache line of the chain's tail, see local_placement().
+    bool local_placement_ = false;
+    /// Function used to hash the keys.
+    Hasher hasher_;
+    /// Function used to compare the keys for equality.
+    KeyEqual key_equal_;
+    /// Slots of the table being migrated by the incremental rehash. Empty when there is no migration.
+    DataVector old_data_;
+    /// Size of the addressable part of the old table.
+    SizeType old_primary_size_ = 0;
+    /// Number of elements that are still in the old table.
+    SizeType old_count_ = 0;
+    /// Position in the old table from which the migration continues.
+    SizeType migrate_pos_ = 0;
+    /// Number of elements moved per mutating operation. Zero means the incremental rehash is disabled.
+    SizeType rehash_step_ = 0;
+    /// TABLE_BIT of identifiers of the current table slots.
+    SizeType current_tag_ = 0;
+    /// Number of threads of the parallel rebuild, zero means the hardware concurrency.
+    SizeType build_threads_ = 1;
+    /// Generation of the slots, that are not cleared yet.
+    SizeType generation_ = 0;
+    /// Counters of the statistics, lookups update them too.
+    mutable typename Stats::Counters stats_;
+
+    /// Number of keys, whose memory is prefetched together by the batched operations.
+    static constexpr SizeType BATCH_SIZE = 32;
+    /// Minimum number of elements, for which Rehash uses the parallel rebuild.
+    static constexpr SizeType PARALLEL_MIN_SIZE = 1ull << 16ull;
+    /// Minimum number of elements in a part of the parallel rebuild.
+    static constexpr SizeType PARALLEL_MIN_PART = 1ull << 12ull;
+    /// Number of bytes, after which write_snapshot flushes its buffer.
+    static constexpr SizeType SNAPSHOT_CHUNK = 1ull << 16ull;
+    /// Size of the cache line, within which local_placement() keeps the hops of chains.
+    static constexpr SizeType CACHE_LINE = 64;
+
+    /// NONE is means there is no link to the next element in chain.
+    static constexpr SizeType NONE = -1;
+    /// The highest bit of slot identifier that tells the table of the slot.
+    static constexpr SizeType TABLE_BIT = ~(NONE >> 1ull);
+    /// Let (cellar_size_ = B * primary_size_) by default. The article says that this is the optimal value.
+    static constexpr float B = 7 / 43.;
+};
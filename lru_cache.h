@@ -0,0 +1,409 @@
+#pragma once
+
+#include "hash_map.h"
+
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+/// Weigher, that counts the bytes of the key and value objects themselves, without the memory they own.
+struct SizeofWeigher {
+    template <class K, class V>
+    size_t operator()(const K &, const V &) const {
+        return sizeof(K) + sizeof(V);
+    }
+};
+
+/// LRU cache is a map bounded by the number of the elements and by their total weight, that Weigher(key, value) gives,
+/// which evicts the least recently used elements. The recency is the iteration order of its HashMap with ListStorage:
+/// a hit moves the node of the element to the back by move_to_back, so it costs a single probe and no list besides the
+/// map. With the time to live the elements expire after ttl since their insertion or assignment. There is no sweeper:
+/// an expired element is erased when it is found, and every operation checks a few least recently used elements. So
+/// size() may count expired elements, that no lookup returns. The cache is not thread-safe, see ConcurrentLruCache.
+template <class Key, class T, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>,
+          class Weigher = SizeofWeigher, class Clock = std::chrono::steady_clock>
+class LruCache {
+    using TimePoint = typename Clock::time_point;
+
+    /// Element of the map: the value, its expiry time and its weight.
+    struct Entry {
+        template <class M>
+        Entry(M &&value, TimePoint expires) : value(std::forward<M>(value)), expires(expires) {
+        }
+
+        T value;
+        TimePoint expires;
+        size_t weight = 0;
+    };
+
+    using Map = HashMap<Key, Entry, Hash, Equal, ListStorage>;
+
+public:
+    /// Public typedefs:
+
+    using KeyType = Key;
+    using MappedType = T;
+    using SizeType = size_t;
+    using Hasher = Hash;
+    using KeyEqual = Equal;
+    using Duration = typename Clock::duration;
+
+    /// Bound, that doesn't limit the cache.
+    static constexpr SizeType UNLIMITED = -1;
+
+    /// Creates an empty cache with the bounds of the number of the elements and of their weight. Zero ttl means the
+    /// elements never expire.
+    explicit LruCache(SizeType max_size = UNLIMITED, SizeType max_weight = UNLIMITED, Duration ttl = Duration::zero(),
+                      const Hasher &hf = Hasher(), const KeyEqual &eq = KeyEqual(), const Weigher &weigher = Weigher())
+        : map_(hf, eq), max_size_(max_size), max_weight_(max_weight), ttl_(ttl), weigher_(weigher) {
+    }
+
+    /// Returns the number of elements, the expired ones, that aren't erased yet, included.
+    SizeType size() const {
+        return map_.size();
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return map_.empty();
+    }
+
+    /// Returns the total weight of the elements.
+    SizeType weight() const {
+        return weight_;
+    }
+
+    /// Returns the maximum number of elements.
+    SizeType max_size() const {
+        return max_size_;
+    }
+
+    /// Sets the maximum number of elements, the least recently used ones beyond it are evicted at once.
+    void max_size(SizeType size) {
+        max_size_ = size;
+        Evict(Now());
+    }
+
+    /// Returns the maximum total weight of the elements.
+    SizeType max_weight() const {
+        return max_weight_;
+    }
+
+    /// Sets the maximum total weight of the elements, the least recently used ones beyond it are evicted at once.
+    void max_weight(SizeType weight) {
+        max_weight_ = weight;
+        Evict(Now());
+    }
+
+    /// Returns the time to live.
+    Duration ttl() const {
+        return ttl_;
+    }
+
+    /// Sets the time to live of the elements inserted or assigned from now on, zero means they never expire.
+    void ttl(Duration ttl) {
+        ttl_ = ttl;
+    }
+
+    /// Returns the mapped value of the key, making its element the most recently used, or nullptr, if there is no such
+    /// element or it expired. The pointer is valid until the element is evicted or erased.
+    MappedType *find(const KeyType &key) {
+        TimePoint now = Now();
+        Expire(now);
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            return nullptr;
+        }
+        if (Expired(it->second, now)) {
+            Remove(it);
+            return nullptr;
+        }
+        map_.move_to_back(it);
+        return &it->second.value;
+    }
+
+    /// Checks whether there is an element with the key, that hasn't expired. The recency isn't changed.
+    bool contains(const KeyType &key) const {
+        auto it = map_.find(key);
+        return it != map_.end() && !Expired(it->second, Now());
+    }
+
+    /// Assigns obj to the mapped value of the key or inserts it, making the element the most recently used and
+    /// restarting its time to live, then evicts the least recently used elements beyond the bounds, this one too, if
+    /// it alone exceeds them. Returns whether the insertion took place.
+    template <class M>
+    bool insert_or_assign(const KeyType &key, M &&obj) {
+        TimePoint now = Now();
+        auto [it, inserted] = map_.try_emplace(key, std::forward<M>(obj), Expiry(now));
+        if (!inserted) {
+            weight_ -= it->second.weight;
+            it->second.value = std::forward<M>(obj);
+            it->second.expires = Expiry(now);
+            map_.move_to_back(it);
+        }
+        it->second.weight = weigher_(it->first, it->second.value);
+        weight_ += it->second.weight;
+        Evict(now);
+        return inserted;
+    }
+
+    /// Erases the element with the key. Returns whether it existed and hadn't expired.
+    bool erase(const KeyType &key) {
+        auto it = map_.find(key);
+        if (it == map_.end()) {
+            return false;
+        }
+        bool expired = Expired(it->second, Now());
+        Remove(it);
+        return !expired;
+    }
+
+    /// Clears the contents.
+    void clear() {
+        map_.clear();
+        weight_ = 0;
+    }
+
+    /// Calls f(const KeyType &, const MappedType &) for the elements from the least recently used one, the expired
+    /// ones included.
+    template <class F>
+    void for_each(F f) const {
+        for (const auto &x : map_) {
+            f(x.first, x.second.value);
+        }
+    }
+
+    /// Returns function used to hash the keys.
+    Hasher hash_function() const {
+        return map_.hash_function();
+    }
+
+private:
+    /// Returns the current time. Elements inserted with a non-zero time to live keep expiring after it is set to
+    /// zero, so the clock is read regardless of it.
+    TimePoint Now() const {
+        return Clock::now();
+    }
+
+    /// Returns the expiry time of an element inserted or assigned at now, the elements never expire with a zero time
+    /// to live.
+    TimePoint Expiry(TimePoint now) const {
+        return ttl_ == Duration::zero() ? TimePoint::max() : now + ttl_;
+    }
+
+    bool Expired(const Entry &entry, TimePoint now) const {
+        return entry.expires <= now;
+    }
+
+    /// Erases up to EXPIRE_STEP expired elements from the least recently used one.
+    void Expire(TimePoint now) {
+        for (SizeType i = 0; i < EXPIRE_STEP && !map_.empty() && Expired(map_.begin()->second, now); ++i) {
+            Remove(map_.begin());
+        }
+    }
+
+    /// Erases the expired elements at the front and the least recently used ones beyond the bounds.
+    void Evict(TimePoint now) {
+        Expire(now);
+        while (!map_.empty() && (map_.size() > max_size_ || weight_ > max_weight_)) {
+            Remove(map_.begin());
+        }
+    }
+
+    template <class Iterator>
+    void Remove(Iterator it) {
+        weight_ -= it->second.weight;
+        /// The key is compared before the element is destroyed, so it may refer to the element itself.
+        map_.erase(it->first);
+    }
+
+    /// Number of the least recently used elements checked for the expiry by an operation.
+    static constexpr SizeType EXPIRE_STEP = 2;
+
+    /// Private fields:
+
+    /// Elements in the order of the recency, the most recently used one is the last.
+    Map map_;
+    SizeType max_size_;
+    SizeType max_weight_;
+    Duration ttl_;
+    /// Total weight of the elements.
+    SizeType weight_ = 0;
+    Weigher weigher_;
+};
+
+/// Concurrent LRU cache is a thread-safe LruCache built on shards, each of them is a LruCache guarded by its own
+/// mutex, since a hit changes the recency. A key goes to the shard chosen by the high bits of its mixed hash, as in
+/// ConcurrentHashMap, and the bounds are split between the shards, so that their parts sum up to the bounds. The
+/// eviction is least recently used per shard, so the recency is approximate: a shard may evict its least recently used
+/// element while another shard holds older ones. Values are copied out, and callbacks see the elements under the lock
+/// of their shard.
+template <class Key, class T, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>,
+          class Weigher = SizeofWeigher, class Clock = std::chrono::steady_clock>
+class ConcurrentLruCache {
+public:
+    /// Public typedefs:
+
+    using Cache = LruCache<Key, T, Hash, Equal, Weigher, Clock>;
+    using KeyType = Key;
+    using MappedType = T;
+    using SizeType = size_t;
+    using Hasher = Hash;
+    using KeyEqual = Equal;
+    using Duration = typename Cache::Duration;
+
+    static constexpr SizeType UNLIMITED = Cache::UNLIMITED;
+
+    /// Creates an empty cache with the bounds as LruCache has and with shard_count shards rounded up to a power of
+    /// two. Zero means four shards per hardware thread. The number of shards is then lowered to a power of two not
+    /// greater than the bounds, so that every shard may hold an element.
+    explicit ConcurrentLruCache(SizeType max_size = UNLIMITED, SizeType max_weight = UNLIMITED,
+                                Duration ttl = Duration::zero(), SizeType shard_count = 0, const Hasher &hf = Hasher(),
+                                const KeyEqual &eq = KeyEqual(), const Weigher &weigher = Weigher())
+        : hasher_(hf) {
+        if (shard_count == 0) {
+            shard_count = std::max<SizeType>(std::thread::hardware_concurrency(), 1) << 2ull;
+        }
+        while ((1ull << shard_bits_) < shard_count) {
+            ++shard_bits_;
+        }
+        while (shard_bits_ > 0 && (1ull << shard_bits_) > std::min(max_size, max_weight)) {
+            --shard_bits_;
+        }
+        shards_ = std::vector<Shard>(1ull << shard_bits_);
+        for (SizeType i = 0; i < shards_.size(); ++i) {
+            shards_[i].cache = Cache(ShardBound(max_size, i), ShardBound(max_weight, i), ttl, hf, eq, weigher);
+        }
+    }
+
+    ConcurrentLruCache(const ConcurrentLruCache &) = delete;
+    ConcurrentLruCache &operator=(const ConcurrentLruCache &) = delete;
+
+    /// Returns the number of elements. Under concurrent modifications it is a snapshot of every shard at some moment.
+    SizeType size() const {
+        SizeType size = 0;
+        for (const auto &shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            size += shard.cache.size();
+        }
+        return size;
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Returns the total weight of the elements.
+    SizeType weight() const {
+        SizeType weight = 0;
+        for (const auto &shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            weight += shard.cache.weight();
+        }
+        return weight;
+    }
+
+    /// Returns the number of shards.
+    SizeType shard_count() const {
+        return shards_.size();
+    }
+
+    /// Clears the contents.
+    void clear() {
+        for (auto &shard : shards_) {
+            std::lock_guard lock(shard.mutex);
+            shard.cache.clear();
+        }
+    }
+
+    /// Copies the mapped value of the key to value, making the element the most recently used in its shard. Returns
+    /// whether the key exists and hasn't expired.
+    bool find(const KeyType &key, MappedType &value) {
+        return visit(key, [&value](const MappedType &x) { value = x; });
+    }
+
+    /// Checks whether the key exists and hasn't expired. The recency isn't changed.
+    bool contains(const KeyType &key) const {
+        const Shard &shard = GetShard(key);
+        std::lock_guard lock(shard.mutex);
+        return shard.cache.contains(key);
+    }
+
+    /// Calls f(MappedType &) for the element with the key under the lock of its shard, making the element the most
+    /// recently used. Returns whether the key exists and hasn't expired.
+    template <class F>
+    bool visit(const KeyType &key, F f) {
+        Shard &shard = GetShard(key);
+        std::lock_guard lock(shard.mutex);
+        MappedType *value = shard.cache.find(key);
+        if (value == nullptr) {
+            return false;
+        }
+        f(*value);
+        return true;
+    }
+
+    /// Assigns obj to the mapped value of the key or inserts it, as LruCache does. Returns whether the insertion took
+    /// place.
+    template <class M>
+    bool insert_or_assign(const KeyType &key, M &&obj) {
+        Shard &shard = GetShard(key);
+        std::lock_guard lock(shard.mutex);
+        return shard.cache.insert_or_assign(key, std::forward<M>(obj));
+    }
+
+    /// Erases the element with the key. Returns whether it existed and hadn't expired.
+    bool erase(const KeyType &key) {
+        Shard &shard = GetShard(key);
+        std::lock_guard lock(shard.mutex);
+        return shard.cache.erase(key);
+    }
+
+    /// Returns function used to hash the keys.
+    Hasher hash_function() const {
+        return hasher_;
+    }
+
+private:
+    /// Shards are aligned to the cache line, so that locks of neighbouring shards don't share it.
+    struct alignas(64) Shard {
+        mutable std::mutex mutex;
+        Cache cache;
+    };
+
+    /// Returns the part of the bound for the shard. The remainder of the even split goes to the first shards, one per
+    /// shard, so the parts sum up to the bound.
+    SizeType ShardBound(SizeType bound, SizeType shard) const {
+        if (bound == UNLIMITED) {
+            return UNLIMITED;
+        }
+        return (bound >> shard_bits_) + (shard < (bound & ((1ull << shard_bits_) - 1)));
+    }
+
+    /// Returns the shard of the key. The hash is mixed and its high bits are taken, since HashMap of the shard uses the
+    /// low ones.
+    Shard &GetShard(const KeyType &key) {
+        return shards_[ShardIndex(key)];
+    }
+
+    const Shard &GetShard(const KeyType &key) const {
+        return shards_[ShardIndex(key)];
+    }
+
+    SizeType ShardIndex(const KeyType &key) const {
+        if (shard_bits_ == 0) {
+            return 0;
+        }
+        return (static_cast<uint64_t>(hasher_(key)) * 0x9E3779B97F4A7C15ull) >> (64ull - shard_bits_);
+    }
+
+    /// Private fields:
+
+    /// Shards of the cache.
+    std::vector<Shard> shards_;
+    /// Number of shards is (1 << shard_bits_).
+    SizeType shard_bits_ = 0;
+    /// Function used to hash the keys.
+    Hasher hasher_;
+};
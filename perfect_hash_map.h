@@ -0,0 +1,368 @@
+#pragma once
+
+#include "hash_map.h"
+
+/// Perfect hash map is an immutable associative container over a fixed set of unique keys, built by the PTHash scheme.
+/// Keys are split into buckets by their hash, and every bucket gets a pilot value, such that the positions of its keys
+/// mixed with the pilot don't collide with any key of the buckets placed before. Positions are taken from a table
+/// ALPHA times larger than the number of keys, and those past the last element are remapped into the holes, so the
+/// elements lie in a dense array without gaps. A lookup reads the pilot of the bucket and compares the key with the
+/// single element it leads to. Mapped values may be modified, the set of keys can't. The hasher must give distinct keys
+/// distinct hashes, since the seed is mixed into its output and can't separate keys with equal hashes.
+template <class Key, class T, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>>
+class PerfectHashMap {
+    /// Enables lookups by the compatible key K, if both Hash and Equal are transparent.
+    template <class K>
+    using EnableIfTransparent =
+        std::enable_if_t<IsTransparent<Hash>::value && IsTransparent<Equal>::value && std::is_same_v<K, K>>;
+
+public:
+    /// Public typedefs:
+
+    using KeyType = Key;
+    using MappedType = T;
+    using ValueType = std::pair<const Key, T>;
+    using SizeType = size_t;
+    using Hasher = Hash;
+    using KeyEqual = Equal;
+
+    /// Since values are contained in the vector, its iterators are used. Iterator-related typedefs:
+
+    using iterator = typename std::vector<ValueType>::iterator;              // NOLINT
+    using const_iterator = typename std::vector<ValueType>::const_iterator;  // NOLINT
+
+    /// Creates the map with the elements from [first, last). Keys and their hashes must be unique, otherwise
+    /// std::invalid_argument is thrown.
+    template <class ForwardIterator>
+    PerfectHashMap(ForwardIterator first, ForwardIterator last, const Hasher &hf = Hasher(),
+                   const KeyEqual &eq = KeyEqual())
+        : hasher_(hf), key_equal_(eq) {
+        std::vector<ForwardIterator> items;
+        for (auto it = first; it != last; ++it) {
+            items.push_back(it);
+        }
+        Build(items);
+    }
+
+    /// Freezes the elements of the hash map with the same key type.
+    template <class... Params>
+    explicit PerfectHashMap(const HashMap<Key, T, Hash, Equal, Params...> &map)
+        : PerfectHashMap(map.begin(), map.end(), map.hash_function(), map.key_eq()) {
+    }
+
+    /// Returns the number of elements.
+    SizeType size() const {
+        return values_.size();
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Returns the mapped value of the element with a key equal to the given one. Throws std::out_of_range, if there
+    /// is no such element.
+    const MappedType &at(const KeyType &key) const {
+        return At(key);
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    const MappedType &at(const K &key) const {
+        return At(key);
+    }
+
+    /// Finds the element with a key equal to the given one.
+    iterator find(const KeyType &key) {
+        return values_.begin() + Find(key);
+    }
+
+    const_iterator find(const KeyType &key) const {
+        return values_.begin() + Find(key);
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    iterator find(const K &key) {
+        return values_.begin() + Find(key);
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    const_iterator find(const K &key) const {
+        return values_.begin() + Find(key);
+    }
+
+    /// Checks whether there is an element with a key equal to the given one.
+    bool contains(const KeyType &key) const {
+        return Find(key) != size();
+    }
+
+    template <class K, class = EnableIfTransparent<K>>
+    bool contains(const K &key) const {
+        return Find(key) != size();
+    }
+
+    iterator begin() {
+        return values_.begin();
+    }
+
+    iterator end() {
+        return values_.end();
+    }
+
+    const_iterator begin() const {
+        return values_.begin();
+    }
+
+    const_iterator end() const {
+        return values_.end();
+    }
+
+    /// Returns function used to hash the keys.
+    Hasher hash_function() const {
+        return hasher_;
+    }
+
+    /// Returns function used to compare the keys for equality.
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+private:
+    /// Returns index of the element with the key or size(), if there is none.
+    template <class K>
+    SizeType Find(const K &key) const {
+        if (values_.empty()) {
+            return 0;
+        }
+        uint64_t hash = KeyHash(key);
+        SizeType pos = Position(hash, PilotHash(pilots_[Bucket(hash)]));
+        if (pos >= values_.size()) {
+            pos = remap_[pos - values_.size()];
+        }
+        return key_equal_(values_[pos].first, key) ? pos : values_.size();
+    }
+
+    template <class K>
+    const MappedType &At(const K &key) const {
+        SizeType pos = Find(key);
+        if (pos == size()) {
+            throw std::out_of_range("_Map_base::at");
+        }
+        return values_[pos].second;
+    }
+
+    /// Finds the pilots for the items, retrying with the next seed up to MAX_ATTEMPTS times if some bucket can't be
+    /// placed, and fills the elements in the order of their positions.
+    template <class ForwardIterator>
+    void Build(const std::vector<ForwardIterator> &items) {
+        SizeType n = items.size();
+        if (n == 0) {
+            return;
+        }
+        table_size_ = std::max<SizeType>(static_cast<SizeType>(static_cast<double>(n) / ALPHA), n);
+        bucket_count_ = std::max<SizeType>(n / LAMBDA, 2);
+        dense_bucket_count_ = std::max<SizeType>(static_cast<SizeType>(bucket_count_ * DENSE_BUCKETS), 1);
+        CheckHashes(items);
+        std::vector<uint64_t> hashes(n);
+        std::vector<SizeType> positions(n);
+        for (SizeType attempt = 0;; ++attempt) {
+            if (attempt == MAX_ATTEMPTS) {
+                throw std::invalid_argument("PerfectHashMap: no seed places the keys");
+            }
+            seed_ = Mix(attempt);
+            for (SizeType i = 0; i < n; ++i) {
+                hashes[i] = KeyHash(items[i]->first);
+            }
+            if (PlaceBuckets(hashes, positions)) {
+                break;
+            }
+        }
+
+        /// Positions past the elements are remapped to the free positions among them in increasing order.
+        std::vector<bool> taken(n);
+        for (SizeType pos : positions) {
+            if (pos < n) {
+                taken[pos] = true;
+            }
+        }
+        remap_.assign(table_size_ - n, 0);
+        SizeType hole = 0;
+        std::vector<SizeType> order(n);
+        for (SizeType i = 0; i < n; ++i) {
+            SizeType pos = positions[i];
+            if (pos >= n) {
+                while (taken[hole]) {
+                    ++hole;
+                }
+                taken[hole] = true;
+                remap_[pos - n] = hole;
+                pos = hole;
+            }
+            order[pos] = i;
+        }
+        values_.reserve(n);
+        for (SizeType i = 0; i < n; ++i) {
+            values_.emplace_back(*items[order[i]]);
+        }
+    }
+
+    /// Throws std::invalid_argument, if two keys have equal hashes, since mixing in the seed keeps them equal for every
+    /// attempt of the build.
+    template <class ForwardIterator>
+    void CheckHashes(const std::vector<ForwardIterator> &items) const {
+        std::vector<std::pair<uint64_t, SizeType>> hashes(items.size());
+        for (SizeType i = 0; i < items.size(); ++i) {
+            hashes[i] = {static_cast<uint64_t>(hasher_(items[i]->first)), i};
+        }
+        std::sort(hashes.begin(), hashes.end());
+        for (SizeType i = 1; i < hashes.size(); ++i) {
+            if (hashes[i - 1].first == hashes[i].first) {
+                if (key_equal_(items[hashes[i - 1].second]->first, items[hashes[i].second]->first)) {
+                    throw std::invalid_argument("PerfectHashMap: duplicate key");
+                }
+                throw std::invalid_argument("PerfectHashMap: distinct keys with equal hashes");
+            }
+        }
+    }
+
+    /// Tries to find pilots of all buckets in the order of decreasing size with the current seed. Returns false, if
+    /// some bucket needs more than MAX_PILOT pilots. The hashes are distinct, since CheckHashes rejects the equal ones
+    /// and mixing in the seed is a bijection.
+    bool PlaceBuckets(const std::vector<uint64_t> &hashes, std::vector<SizeType> &positions) {
+        SizeType n = hashes.size();
+        /// Counting sort of the keys by bucket. The hashes are copied in the same order, so that the pilot search reads
+        /// the hashes of a bucket together.
+        std::vector<SizeType> bucket_start(bucket_count_ + 1);
+        for (SizeType i = 0; i < n; ++i) {
+            ++bucket_start[Bucket(hashes[i]) + 1];
+        }
+        SizeType max_bucket_size = 0;
+        for (SizeType b = 0; b < bucket_count_; ++b) {
+            max_bucket_size = std::max(max_bucket_size, bucket_start[b + 1]);
+            bucket_start[b + 1] += bucket_start[b];
+        }
+        std::vector<SizeType> keys(n);
+        std::vector<uint64_t> bucket_hashes(n);
+        std::vector<SizeType> fill(bucket_start.begin(), bucket_start.end() - 1);
+        for (SizeType i = 0; i < n; ++i) {
+            SizeType k = fill[Bucket(hashes[i])]++;
+            keys[k] = i;
+            bucket_hashes[k] = hashes[i];
+        }
+        /// Larger buckets are placed first, while there are many free positions.
+        std::vector<SizeType> size_start(max_bucket_size + 2);
+        for (SizeType b = 0; b < bucket_count_; ++b) {
+            ++size_start[max_bucket_size - (bucket_start[b + 1] - bucket_start[b]) + 1];
+        }
+        for (SizeType size = 0; size <= max_bucket_size; ++size) {
+            size_start[size + 1] += size_start[size];
+        }
+        std::vector<SizeType> order(bucket_count_);
+        for (SizeType b = 0; b < bucket_count_; ++b) {
+            order[size_start[max_bucket_size - (bucket_start[b + 1] - bucket_start[b])]++] = b;
+        }
+        pilots_.assign(bucket_count_, 0);
+        std::vector<bool> taken(table_size_);
+        std::vector<SizeType> bucket_positions(n);
+        for (SizeType b : order) {
+            SizeType first = bucket_start[b], last = bucket_start[b + 1];
+            if (first == last) {
+                break;
+            }
+            uint32_t pilot = 0;
+            while (!TryPilot(bucket_hashes.data(), first, last, PilotHash(pilot), taken, bucket_positions)) {
+                if (++pilot == MAX_PILOT) {
+                    return false;
+                }
+            }
+            pilots_[b] = pilot;
+        }
+        for (SizeType k = 0; k < n; ++k) {
+            positions[keys[k]] = bucket_positions[k];
+        }
+        return true;
+    }
+
+    /// Takes the positions of the keys [first, last) of a bucket with the pilot hash, if all of them are free and
+    /// distinct.
+    bool TryPilot(const uint64_t *hashes, SizeType first, SizeType last, uint64_t pilot_hash, std::vector<bool> &taken,
+                  std::vector<SizeType> &positions) const {
+        for (SizeType k = first; k < last; ++k) {
+            SizeType pos = Position(hashes[k], pilot_hash);
+            if (taken[pos]) {
+                /// Frees the positions taken by this pilot.
+                for (SizeType j = first; j < k; ++j) {
+                    taken[positions[j]] = false;
+                }
+                return false;
+            }
+            taken[pos] = true;
+            positions[k] = pos;
+        }
+        return true;
+    }
+
+    /// Returns the hash of the key mixed with the seed, so that every attempt of the build sees other hashes.
+    template <class K>
+    uint64_t KeyHash(const K &key) const {
+        return Mix(static_cast<uint64_t>(hasher_(key)) ^ seed_);
+    }
+
+    /// Returns the bucket of the hash. The hashes with the low half below DENSE_THRESHOLD, that are 60% of them, go to
+    /// DENSE_BUCKETS of the buckets. The skew makes large buckets, that are placed while the table is almost empty, and
+    /// leaves the small ones for the end.
+    SizeType Bucket(uint64_t hash) const {
+        uint64_t high = hash >> 32ull;
+        if ((hash & 0xFFFFFFFFull) < DENSE_THRESHOLD) {
+            return (high * dense_bucket_count_) >> 32ull;
+        }
+        return dense_bucket_count_ + ((high * (bucket_count_ - dense_bucket_count_)) >> 32ull);
+    }
+
+    /// Returns the position of the hash with the pilot hash in the table.
+    SizeType Position(uint64_t hash, uint64_t pilot_hash) const {
+        return FastRangeGrowPolicy::Index(hash ^ pilot_hash, table_size_);
+    }
+
+    uint64_t PilotHash(uint32_t pilot) const {
+        return Mix(pilot ^ seed_);
+    }
+
+    /// Finalizer of SplitMix64.
+    static uint64_t Mix(uint64_t x) {
+        x = (x ^ (x >> 30ull)) * 0xBF58476D1CE4E5B9ull;
+        x = (x ^ (x >> 27ull)) * 0x94D049BB133111EBull;
+        return x ^ (x >> 31ull);
+    }
+
+    /// Private fields:
+
+    /// Elements in the order of their positions.
+    std::vector<ValueType> values_;
+    /// Pilot of every bucket.
+    std::vector<uint32_t> pilots_;
+    /// Elements of the positions past the last one.
+    std::vector<SizeType> remap_;
+    /// Number of positions, to which keys are placed.
+    SizeType table_size_ = 0;
+    /// Number of buckets and the part of them that gets most keys. The buckets count is less than 2^32.
+    SizeType bucket_count_ = 0;
+    SizeType dense_bucket_count_ = 0;
+    /// Seed of the successful build attempt.
+    uint64_t seed_ = 0;
+    /// Function used to hash the keys.
+    Hasher hasher_;
+    /// Function used to compare the keys for equality.
+    KeyEqual key_equal_;
+
+    /// Number of keys per position of the table.
+    static constexpr double ALPHA = 0.99;
+    /// Average number of keys in a bucket.
+    static constexpr SizeType LAMBDA = 3;
+    /// Ratios of the skewed bucket assignment.
+    static constexpr double DENSE_BUCKETS = 0.3;
+    static constexpr uint64_t DENSE_THRESHOLD = static_cast<uint64_t>(0.6 * 4294967296.0);
+    /// Number of pilots tried for a bucket, before the build restarts with the next seed.
+    static constexpr uint32_t MAX_PILOT = 1u << 24u;
+    /// Maximum number of seeds tried by the build.
+    static constexpr SizeType MAX_ATTEMPTS = 64;
+};
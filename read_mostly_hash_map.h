@@ -0,0 +1,252 @@
+#pragma once
+
+#include "hash_map.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+/// Epoch based reclamation shared by all read-mostly maps. A reader announces the global epoch in its own record for
+/// the time of its critical section, and a writer, that has unlinked some memory, advances the epoch and waits until no
+/// record announces an epoch that isn't newer. Readers never write shared cache lines, except their own record.
+class EpochDomain {
+public:
+    /// Critical section of the reader. Sections may nest, only the outermost one announces the epoch.
+    class Guard {
+    public:
+        Guard() {
+            Record *record = ThreadRecord();
+            if (record->depth++ == 0) {
+                /// The announcement must be visible before the shared pointer is loaded, which the store alone doesn't
+                /// order, so the fence pairs with the one of Synchronize. The epoch is acquired, so a reader, that
+                /// announces a newer epoch than the writer, sees its new pointer.
+                record->epoch.store(epoch_.load(std::memory_order_acquire), std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+            }
+        }
+
+        ~Guard() {
+            Record *record = thread_record_.record;
+            if (--record->depth == 0) {
+                record->epoch.store(0, std::memory_order_release);
+            }
+        }
+
+        Guard(const Guard &) = delete;
+        Guard &operator=(const Guard &) = delete;
+    };
+
+    /// Waits until every reader, that could load a pointer unlinked before the call, leaves its critical section.
+    static void Synchronize() {
+        uint64_t epoch = epoch_.fetch_add(1);
+        /// Pairs with the fence of Guard: the unlinking store is ordered before the scan of the records.
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        for (Record *record = head_.load(std::memory_order_acquire); record != nullptr; record = record->next) {
+            while (true) {
+                uint64_t announced = record->epoch.load(std::memory_order_acquire);
+                if (announced == 0 || announced > epoch) {
+                    break;
+                }
+                std::this_thread::yield();
+            }
+        }
+    }
+
+private:
+    /// Record of a thread. Records are never freed, the record of a finished thread is reused by a new one.
+    struct alignas(64) Record {
+        /// Announced epoch or zero outside of critical sections.
+        std::atomic<uint64_t> epoch{0};
+        std::atomic<bool> in_use{true};
+        /// Depth of nested critical sections, only the owning thread touches it.
+        size_t depth = 0;
+        Record *next = nullptr;
+    };
+
+    /// Releases the record, when its thread finishes.
+    struct RecordHolder {
+        Record *record;
+
+        constexpr RecordHolder() : record(nullptr) {
+        }
+
+        ~RecordHolder() {
+            if (record != nullptr) {
+                record->in_use.store(false, std::memory_order_release);
+            }
+        }
+    };
+
+    /// Returns the record of the current thread, taking a free one or adding a new one on the first call.
+    static Record *ThreadRecord() {
+        if (thread_record_.record != nullptr) {
+            return thread_record_.record;
+        }
+        Record *head = head_.load(std::memory_order_acquire);
+        for (Record *record = head; record != nullptr; record = record->next) {
+            bool in_use = false;
+            if (!record->in_use.load(std::memory_order_relaxed) &&
+                record->in_use.compare_exchange_strong(in_use, true, std::memory_order_acquire)) {
+                return thread_record_.record = record;
+            }
+        }
+        auto *record = new Record();
+        record->next = head;
+        while (!head_.compare_exchange_weak(record->next, record, std::memory_order_acq_rel)) {
+        }
+        return thread_record_.record = record;
+    }
+
+    /// Global epoch, it starts from one, since zero means no critical section.
+    inline static std::atomic<uint64_t> epoch_{1};
+    /// List of the records of all threads.
+    inline static std::atomic<Record *> head_{nullptr};
+    inline static thread_local RecordHolder thread_record_;
+};
+
+/// Read-mostly hash map is a thread-safe wrapper of HashMap, whose lookups take no locks and write no shared memory.
+/// The map is an immutable snapshot published through an atomic pointer. Writers are serialized: a writer copies the
+/// snapshot, modifies the copy and publishes it, and the previous snapshot is freed after the readers that may still
+/// see it leave, as EpochDomain tells. So a write costs a copy of the whole map, and update() applies many
+/// modifications with one copy. The template parameters are passed to HashMap.
+template <class Key, class T, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>,
+          class Storage = ListStorage, class GrowPolicy = PrimeGrowPolicy, class HashCache = NoHashCache,
+          class SlotIndex = size_t, class Allocator = std::allocator<std::pair<const Key, T>>, class Stats = NoStats>
+class ReadMostlyHashMap {
+public:
+    /// Public typedefs:
+
+    using Map = HashMap<Key, T, Hash, Equal, Storage, GrowPolicy, HashCache, SlotIndex, Allocator, Stats>;
+    using KeyType = Key;
+    using MappedType = T;
+    using ValueType = std::pair<const Key, T>;
+    using SizeType = size_t;
+
+    /// Creates the map with the given contents.
+    explicit ReadMostlyHashMap(Map map = Map()) : map_(new Map(std::move(map))) {
+    }
+
+    ReadMostlyHashMap(const ReadMostlyHashMap &) = delete;
+    ReadMostlyHashMap &operator=(const ReadMostlyHashMap &) = delete;
+
+    /// No reader may use the map during its destruction.
+    ~ReadMostlyHashMap() {
+        delete map_.load(std::memory_order_relaxed);
+    }
+
+    /// Returns the number of elements.
+    SizeType size() const {
+        EpochDomain::Guard guard;
+        return map_.load(std::memory_order_acquire)->size();
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Copies the mapped value of the key to value. Returns whether the key exists.
+    bool find(const KeyType &key, MappedType &value) const {
+        return visit(key, [&value](const ValueType &x) { value = x.second; });
+    }
+
+    /// Checks whether the key exists.
+    bool contains(const KeyType &key) const {
+        return visit(key, [](const ValueType &) {});
+    }
+
+    /// Returns a copy of the mapped value of the key, since a reference would outlive the snapshot. Throws
+    /// std::out_of_range as HashMap::at does, if there is no such element.
+    MappedType at(const KeyType &key) const {
+        return read([&key](const Map &map) -> MappedType { return map.at(key); });
+    }
+
+    /// Calls f(const ValueType &) for the element with the key in the current snapshot. Returns whether the key exists.
+    template <class F>
+    bool visit(const KeyType &key, F f) const {
+        EpochDomain::Guard guard;
+        const Map *map = map_.load(std::memory_order_acquire);
+        auto it = map->find(key);
+        if (it == map->end()) {
+            return false;
+        }
+        f(*it);
+        return true;
+    }
+
+    /// Calls f(const Map &) with the current snapshot, which stays alive until f returns.
+    template <class F>
+    auto read(F f) const {
+        EpochDomain::Guard guard;
+        return f(*map_.load(std::memory_order_acquire));
+    }
+
+    /// Calls f(Map &) with a copy of the current snapshot and publishes the copy. Returns the result of f.
+    template <class F>
+    auto update(F f) {
+        std::lock_guard lock(write_mutex_);
+        auto map = std::make_unique<Map>(*map_.load(std::memory_order_relaxed));
+        if constexpr (std::is_void_v<decltype(f(*map))>) {
+            f(*map);
+            Publish(std::move(map));
+        } else {
+            auto result = f(*map);
+            Publish(std::move(map));
+            return result;
+        }
+    }
+
+    /// Replaces the contents by the given map without copying it.
+    void assign(Map map) {
+        std::lock_guard lock(write_mutex_);
+        Publish(std::make_unique<Map>(std::move(map)));
+    }
+
+    /// Assigns obj to the mapped value of the key or inserts it. Returns whether the insertion took place.
+    template <class M>
+    bool insert_or_assign(const KeyType &key, M &&obj) {
+        return update([&](Map &map) {
+            auto [it, inserted] = map.try_emplace(key, std::forward<M>(obj));
+            if (!inserted) {
+                it->second = std::forward<M>(obj);
+            }
+            return inserted;
+        });
+    }
+
+    /// Inserts the element, if there is no element with its key. Returns whether the insertion took place.
+    bool insert(const ValueType &x) {
+        return update([&](Map &map) { return map.insert(x).second; });
+    }
+
+    /// Erases the element with the key. Returns whether it existed.
+    bool erase(const KeyType &key) {
+        return update([&](Map &map) {
+            if (map.find(key) == map.end()) {
+                return false;
+            }
+            map.erase(key);
+            return true;
+        });
+    }
+
+    /// Clears the contents.
+    void clear() {
+        assign(Map());
+    }
+
+private:
+    /// Makes the map the current snapshot and frees the previous one, when no reader sees it.
+    void Publish(std::unique_ptr<Map> map) {
+        std::unique_ptr<const Map> old(map_.exchange(map.release()));
+        EpochDomain::Synchronize();
+    }
+
+    /// Private fields:
+
+    /// Current snapshot.
+    std::atomic<const Map *> map_;
+    /// Serializes the writers.
+    std::mutex write_mutex_;
+};
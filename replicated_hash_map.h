@@ -0,0 +1,398 @@
+#pragma once
+
+#include "hash_map.h"
+#include "read_mostly_hash_map.h"
+
+#include <atomic>
+#include <exception>
+#include <fstream>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/// NUMA topology of the machine as Linux reports it. Elsewhere the machine is a single node.
+class NumaTopology {
+public:
+    /// Returns the number of the nodes, that is one more than the highest online node.
+    static size_t NodeCount() {
+        static const size_t count = ReadNodeCount();
+        return count;
+    }
+
+    /// Returns the node of the CPU, that runs the current thread. A thread rarely moves to another socket, so the node
+    /// is asked from the system once in NODE_REFRESH calls.
+    static size_t CurrentNode() {
+        thread_local size_t node = 0;
+        thread_local size_t calls = 0;
+        if (calls++ % NODE_REFRESH == 0) {
+            node = ReadCurrentNode();
+        }
+        return node;
+    }
+
+private:
+    /// Parses the list of the online nodes like "0-1,3", the last number is the highest node.
+    static size_t ReadNodeCount() {
+        std::ifstream in("/sys/devices/system/node/online");
+        std::string line;
+        if (!std::getline(in, line)) {
+            return 1;
+        }
+        size_t end = line.find_last_of("0123456789");
+        if (end == std::string::npos) {
+            return 1;
+        }
+        size_t begin = line.find_last_not_of("0123456789", end);
+        begin = begin == std::string::npos ? 0 : begin + 1;
+        return std::stoul(line.substr(begin, end - begin + 1)) + 1;
+    }
+
+    static size_t ReadCurrentNode() {
+#ifdef __linux__
+        unsigned cpu = 0;
+        unsigned node = 0;
+        if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0) {
+            return node;
+        }
+#endif
+        return 0;
+    }
+
+    static constexpr size_t NODE_REFRESH = 1024;
+};
+
+/// Memory resource, whose allocations of a page or more are mapped with the node as the preferred one, so their pages
+/// are placed on the node, when they are touched first. Smaller allocations go to the global operator new. Binding is
+/// a hint: where the system doesn't support it, the memory is taken as usual.
+class NumaMemoryResource : public std::pmr::memory_resource {
+public:
+    explicit NumaMemoryResource(size_t node) : node_(node) {
+    }
+
+    /// Returns the resource of the node, it is never destroyed, so a container may keep it till the end of the program.
+    static NumaMemoryResource *ForNode(size_t node) {
+        static auto *resources = [] {
+            auto *result = new std::vector<NumaMemoryResource>();
+            result->reserve(NumaTopology::NodeCount());
+            for (size_t i = 0; i < NumaTopology::NodeCount(); ++i) {
+                result->emplace_back(i);
+            }
+            return result;
+        }();
+        return &resources->at(node);
+    }
+
+    /// Returns the node of the memory.
+    size_t node() const {
+        return node_;
+    }
+
+private:
+    void *do_allocate(size_t size, size_t alignment) override {
+#ifdef __linux__
+        if (IsMapped(size, alignment)) {
+            void *pointer = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (pointer == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            if (node_ < MAX_NODES) {
+                uint64_t mask[MAX_NODES / 64] = {};
+                mask[node_ / 64] = 1ull << (node_ % 64);
+                /// The kernel takes one bit less than maxnode.
+                syscall(SYS_mbind, pointer, size, MPOL_PREFERRED, mask, MAX_NODES + 1, 0);
+            }
+            return pointer;
+        }
+#endif
+        return ::operator new(size, std::align_val_t(alignment));
+    }
+
+    void do_deallocate(void *pointer, size_t size, size_t alignment) override {
+#ifdef __linux__
+        if (IsMapped(size, alignment)) {
+            munmap(pointer, size);
+            return;
+        }
+#endif
+        ::operator delete(pointer, size, std::align_val_t(alignment));
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override {
+        const auto *numa = dynamic_cast<const NumaMemoryResource *>(&other);
+        return numa != nullptr && numa->node_ == node_;
+    }
+
+    static bool IsMapped(size_t size, size_t alignment) {
+        return size >= PAGE_SIZE && alignment <= PAGE_SIZE;
+    }
+
+    static constexpr size_t PAGE_SIZE = 4096;
+    /// Size of the node mask and the policy of mbind from numaif.h.
+    static constexpr size_t MAX_NODES = 1024;
+    static constexpr int MPOL_PREFERRED = 1;
+
+    size_t node_;
+};
+
+/// Replicated hash map is a thread-safe read-mostly map for multi-socket machines, whose lookups read only the memory
+/// of the NUMA node of the calling thread. Every node has a replica of two HashMaps: the current one serves the
+/// readers, and the standby one takes the writes. The slot tables and the elements of both are allocated on the node,
+/// the replicas themselves too.
+///
+/// Writers are serialized. A write is applied to the standby maps of all nodes, which are then published as current,
+/// and as soon as the readers leave the previous maps, as EpochDomain tells, the same write is replayed on them. So a
+/// write costs two applications per node instead of a copy of the map, that ReadMostlyHashMap pays, and update()
+/// applies many modifications as one write. The template parameters are passed to HashMap, whose elements are
+/// allocated by PoolAllocator over the memory of the node.
+template <class Key, class T, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>,
+          class Storage = ListStorage, class GrowPolicy = PrimeGrowPolicy, class HashCache = NoHashCache,
+          class SlotIndex = size_t, class Stats = NoStats>
+class ReplicatedHashMap {
+public:
+    /// Public typedefs:
+
+    using Map = HashMap<Key, T, Hash, Equal, Storage, GrowPolicy, HashCache, SlotIndex,
+                        PoolAllocator<std::pair<const Key, T>>, Stats>;
+    using KeyType = Key;
+    using MappedType = T;
+    using ValueType = std::pair<const Key, T>;
+    using SizeType = size_t;
+
+    /// Creates the map, copying the given contents to every node.
+    explicit ReplicatedHashMap(const Map &map = Map()) {
+        replicas_.reserve(NumaTopology::NodeCount());
+        for (size_t node = 0; node < NumaTopology::NodeCount(); ++node) {
+            replicas_.push_back(MakeReplica(node, map));
+        }
+    }
+
+    ReplicatedHashMap(const ReplicatedHashMap &) = delete;
+    ReplicatedHashMap &operator=(const ReplicatedHashMap &) = delete;
+
+    /// No reader may use the map during its destruction.
+    ~ReplicatedHashMap() = default;
+
+    /// Returns the number of replicas, one per NUMA node.
+    SizeType replica_count() const {
+        return replicas_.size();
+    }
+
+    /// Returns the number of elements.
+    SizeType size() const {
+        EpochDomain::Guard guard;
+        return Local().size();
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Copies the mapped value of the key to value. Returns whether the key exists.
+    bool find(const KeyType &key, MappedType &value) const {
+        return visit(key, [&value](const ValueType &x) { value = x.second; });
+    }
+
+    /// Checks whether the key exists.
+    bool contains(const KeyType &key) const {
+        return visit(key, [](const ValueType &) {});
+    }
+
+    /// Calls f(const ValueType &) for the element with the key in the local replica. Returns whether the key exists.
+    template <class F>
+    bool visit(const KeyType &key, F f) const {
+        EpochDomain::Guard guard;
+        const Map &map = Local();
+        auto it = map.find(key);
+        if (it == map.end()) {
+            return false;
+        }
+        f(*it);
+        return true;
+    }
+
+    /// Calls f(const Map &) with the current map of the local replica, which stays alive until f returns.
+    template <class F>
+    auto read(F f) const {
+        EpochDomain::Guard guard;
+        return f(Local());
+    }
+
+    /// Calls f(Map &) for both maps of every replica, as the class describes. Since the maps must stay equal, f must
+    /// modify equal maps equally and must not move from its captures. Returns the result of the first call. If f
+    /// throws, the maps it modified are restored by copying and the exception is passed on.
+    template <class F>
+    auto update(F f) {
+        std::lock_guard lock(write_mutex_);
+        if constexpr (std::is_void_v<decltype(f(std::declval<Map &>()))>) {
+            ApplyToStandby(f);
+            Publish(f);
+        } else {
+            auto result = ApplyToStandby(f);
+            Publish(f);
+            return result;
+        }
+    }
+
+    /// Replaces the contents by copies of the given map.
+    void assign(const Map &map) {
+        update([&map](Map &x) { x = map; });
+    }
+
+    /// Assigns obj to the mapped value of the key or inserts it. Returns whether the insertion took place.
+    bool insert_or_assign(const KeyType &key, const MappedType &obj) {
+        return update([&](Map &map) {
+            auto [it, inserted] = map.try_emplace(key, obj);
+            if (!inserted) {
+                it->second = obj;
+            }
+            return inserted;
+        });
+    }
+
+    /// Inserts the element, if there is no element with its key. Returns whether the insertion took place.
+    bool insert(const ValueType &x) {
+        return update([&](Map &map) { return map.insert(x).second; });
+    }
+
+    /// Erases the element with the key. Returns whether it existed.
+    bool erase(const KeyType &key) {
+        return update([&](Map &map) {
+            if (map.find(key) == map.end()) {
+                return false;
+            }
+            map.erase(key);
+            return true;
+        });
+    }
+
+    /// Clears the contents.
+    void clear() {
+        update([](Map &map) { map.clear(); });
+    }
+
+private:
+    /// Maps of a node. It lies in the memory of the node itself, so the readers find the current map without a remote
+    /// access.
+    struct alignas(64) Replica {
+        Replica(size_t node, const Map &map)
+            : node(node), maps{Map(map, Allocator(node)), Map(map, Allocator(node))}, current(&maps[0]) {
+        }
+
+        static typename Map::AllocatorType Allocator(size_t node) {
+            return typename Map::AllocatorType(NumaMemoryResource::ForNode(node));
+        }
+
+        Map &Standby() {
+            return maps[current_index ^ 1];
+        }
+
+        /// Makes the standby map current.
+        void Flip() {
+            current_index ^= 1;
+            current.store(&maps[current_index], std::memory_order_release);
+        }
+
+        size_t node;
+        Map maps[2];
+        /// Current map for the readers.
+        std::atomic<const Map *> current;
+        /// Index of the current map, only the writer uses it.
+        size_t current_index = 0;
+    };
+
+    /// Frees the replica with the memory of its node.
+    struct ReplicaDeleter {
+        void operator()(Replica *replica) const {
+            NumaMemoryResource *resource = NumaMemoryResource::ForNode(replica->node);
+            replica->~Replica();
+            resource->deallocate(replica, REPLICA_SIZE, alignof(Replica));
+        }
+    };
+
+    using ReplicaPointer = std::unique_ptr<Replica, ReplicaDeleter>;
+
+    static ReplicaPointer MakeReplica(size_t node, const Map &map) {
+        NumaMemoryResource *resource = NumaMemoryResource::ForNode(node);
+        void *memory = resource->allocate(REPLICA_SIZE, alignof(Replica));
+        try {
+            return ReplicaPointer(new (memory) Replica(node, map));
+        } catch (...) {
+            resource->deallocate(memory, REPLICA_SIZE, alignof(Replica));
+            throw;
+        }
+    }
+
+    /// Returns the current map of the replica of the current thread's node.
+    const Map &Local() const {
+        SizeType node = NumaTopology::CurrentNode();
+        return *replicas_[node < replicas_.size() ? node : 0]->current.load(std::memory_order_acquire);
+    }
+
+    /// Calls f for the standby maps of all replicas and returns the result of the first call. If it throws, the
+    /// standby maps are restored from the current ones.
+    template <class F>
+    auto ApplyToStandby(F &f) {
+        try {
+            if constexpr (std::is_void_v<decltype(f(std::declval<Map &>()))>) {
+                for (auto &replica : replicas_) {
+                    f(replica->Standby());
+                }
+            } else {
+                auto result = f(replicas_[0]->Standby());
+                for (SizeType i = 1; i < replicas_.size(); ++i) {
+                    f(replicas_[i]->Standby());
+                }
+                return result;
+            }
+        } catch (...) {
+            for (auto &replica : replicas_) {
+                replica->Standby() = replica->maps[replica->current_index];
+            }
+            throw;
+        }
+    }
+
+    /// Makes the standby maps current and replays f on the previous maps, when no reader sees them. A map, for which f
+    /// throws, is restored from the current one, and the first exception is passed on after all replicas.
+    template <class F>
+    void Publish(F &f) {
+        for (auto &replica : replicas_) {
+            replica->Flip();
+        }
+        EpochDomain::Synchronize();
+        std::exception_ptr error;
+        for (auto &replica : replicas_) {
+            try {
+                f(replica->Standby());
+            } catch (...) {
+                if (!error) {
+                    error = std::current_exception();
+                }
+                replica->Standby() = replica->maps[replica->current_index];
+            }
+        }
+        if (error) {
+            std::rethrow_exception(error);
+        }
+    }
+
+    /// Replicas are allocated by pages, so every one is mapped on its node.
+    static constexpr SizeType REPLICA_SIZE = (sizeof(Replica) + 4095) / 4096 * 4096;
+
+    /// Private fields:
+
+    /// Replicas by the node.
+    std::vector<ReplicaPointer> replicas_;
+    /// Serializes the writers.
+    std::mutex write_mutex_;
+};
@@ -0,0 +1,516 @@
+#pragma once
+
+#include "hash_map.h"
+
+#include <memory>
+
+/// Small hash map keeps up to N elements inline in the object and searches them linearly by the equality, without
+/// hashing, so default construction and a map of at most N elements allocate nothing. The insertion of the (N + 1)-th
+/// element moves all elements into a HashMap on the heap, that serves every operation from then on, and
+/// shrink_to_fit() brings the elements back inline, if they fit. Inline elements are erased with swap-with-last, like
+/// DenseStorage does, therefore iterators and references are invalidated by erase and by the move between the modes.
+/// The template parameters after N are passed to HashMap.
+template <class Key, class T, size_t N = 8, class Hash = std::hash<Key>, class Equal = std::equal_to<Key>,
+          class Storage = ListStorage, class GrowPolicy = PrimeGrowPolicy, class HashCache = NoHashCache,
+          class SlotIndex = size_t, class Allocator = std::allocator<std::pair<const Key, T>>, class Stats = NoStats>
+class SmallHashMap {
+    static_assert(N > 0, "SmallHashMap needs room for an inline element");
+
+    /// Enables lookups by the compatible key K, if both Hash and Equal are transparent.
+    template <class K>
+    using EnableIfTransparent =
+        std::enable_if_t<IsTransparent<Hash>::value && IsTransparent<Equal>::value && std::is_same_v<K, K>>;
+
+public:
+    /// Public typedefs:
+
+    using Map = HashMap<Key, T, Hash, Equal, Storage, GrowPolicy, HashCache, SlotIndex, Allocator, Stats>;
+    using KeyType = Key;
+    using MappedType = T;
+    using ValueType = std::pair<const Key, T>;
+    using SizeType = size_t;
+    using Hasher = Hash;
+    using KeyEqual = Equal;
+
+    static_assert(std::is_same_v<typename std::iterator_traits<typename Map::iterator>::reference, ValueType &>,
+                  "SmallHashMap needs a storage of pairs");
+
+private:
+    /// Iterator is the pointer to an inline element or the iterator of the map, the pointer is nullptr in the latter
+    /// case.
+    template <bool Const>
+    class Iterator {
+        using Pointer = std::conditional_t<Const, const ValueType *, ValueType *>;
+        using MapIterator = std::conditional_t<Const, typename Map::const_iterator, typename Map::iterator>;
+
+    public:
+        using iterator_category = std::forward_iterator_tag;  // NOLINT
+        using value_type = ValueType;                         // NOLINT
+        using difference_type = std::ptrdiff_t;               // NOLINT
+        using pointer = Pointer;                              // NOLINT
+        using reference = std::conditional_t<Const, const ValueType &, ValueType &>;  // NOLINT
+
+        Iterator() = default;
+
+        /// Iterator converts to the const one.
+        template <bool C, class = std::enable_if_t<Const && !C>>
+        Iterator(const Iterator<C> &other) : pointer_(other.pointer_), map_iterator_(other.map_iterator_) {
+        }
+
+        reference operator*() const {
+            return pointer_ != nullptr ? *pointer_ : *map_iterator_;
+        }
+
+        pointer operator->() const {
+            return &**this;
+        }
+
+        Iterator &operator++() {
+            if (pointer_ != nullptr) {
+                ++pointer_;
+            } else {
+                ++map_iterator_;
+            }
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++*this;
+            return old;
+        }
+
+        bool operator==(const Iterator &other) const {
+            return pointer_ == other.pointer_ && (pointer_ != nullptr || map_iterator_ == other.map_iterator_);
+        }
+
+        bool operator!=(const Iterator &other) const {
+            return !(*this == other);
+        }
+
+    private:
+        friend class SmallHashMap;
+        friend class Iterator<!Const>;
+
+        explicit Iterator(Pointer pointer) : pointer_(pointer) {
+        }
+
+        explicit Iterator(MapIterator map_iterator) : map_iterator_(map_iterator) {
+        }
+
+        Pointer pointer_ = nullptr;
+        MapIterator map_iterator_{};
+    };
+
+public:
+    /// Iterator-related typedefs:
+
+    using iterator = Iterator<false>;       // NOLINT
+    using const_iterator = Iterator<true>;  // NOLINT
+
+    /// Default constructor creates no elements and allocates nothing.
+    explicit SmallHashMap(const Hasher &hf = Hasher(), const KeyEqual &eq = KeyEqual()) : hasher_(hf), key_equal_(eq) {
+    }
+
+    /// Create an hash map consisting of copies of the elements from [first, last).
+    template <typename InputIterator>
+    SmallHashMap(InputIterator first, InputIterator last, const Hasher &hf = Hasher(), const KeyEqual &eq = KeyEqual())
+        : SmallHashMap(hf, eq) {
+        for (; first != last; ++first) {
+            insert(*first);
+        }
+    }
+
+    /// Create an hash map consisting of copies of the elements in the list.
+    SmallHashMap(std::initializer_list<std::pair<KeyType, MappedType>> list, const Hasher &hf = Hasher(),
+                 const KeyEqual &eq = KeyEqual())
+        : SmallHashMap(list.begin(), list.end(), hf, eq) {
+    }
+
+    /// Copy constructor.
+    SmallHashMap(const SmallHashMap &other) : SmallHashMap(other.hasher_, other.key_equal_) {
+        if (other.map_ != nullptr) {
+            map_ = std::make_unique<Map>(*other.map_);
+            return;
+        }
+        for (; size_ < other.size_; ++size_) {
+            new (Elements() + size_) ValueType(other.Element(size_));
+        }
+    }
+
+    /// Move constructor. The other hash map is left empty.
+    SmallHashMap(SmallHashMap &&other) : SmallHashMap(other.hasher_, other.key_equal_) {
+        MoveFrom(other);
+    }
+
+    /// Copy assignment operator.
+    SmallHashMap &operator=(const SmallHashMap &other) {
+        if (this != &other) {
+            SmallHashMap copy(other);
+            *this = std::move(copy);
+        }
+        return *this;
+    }
+
+    /// Move assignment operator. The other hash map is left empty.
+    SmallHashMap &operator=(SmallHashMap &&other) {
+        if (this != &other) {
+            DestroyInline();
+            map_.reset();
+            hasher_ = other.hasher_;
+            key_equal_ = other.key_equal_;
+            MoveFrom(other);
+        }
+        return *this;
+    }
+
+    ~SmallHashMap() {
+        DestroyInline();
+    }
+
+    /// Exchanges the contents with the other hash map. Inline elements are moved, so iterators are invalidated.
+    void swap(SmallHashMap &other) {
+        SmallHashMap moved(std::move(other));
+        other = std::move(*this);
+        *this = std::move(moved);
+    }
+
+    /// Returns the number of elements.
+    SizeType size() const {
+        return map_ != nullptr ? map_->size() : size_;
+    }
+
+    /// Checks whether the container is empty.
+    bool empty() const {
+        return size() == 0;
+    }
+
+    /// Clears the contents. The map of the elements, if there is one, is kept with its capacity.
+    void clear() {
+        if (map_ != nullptr) {
+            map_->clear();
+        } else {
+            DestroyInline();
+        }
+    }
+
+    /// Prepares the container for n elements. More than N elements are moved into the map at once.
+    void reserve(SizeType n) {
+        if (map_ == nullptr && n > N) {
+            Spill(n);
+        } else if (map_ != nullptr) {
+            map_->reserve(n);
+        }
+    }
+
+    /// Brings the elements back inline, if there are at most N of them, and frees the map. Otherwise shrinks the map.
+    void shrink_to_fit() {
+        if (map_ == nullptr) {
+            return;
+        }
+        if (map_->size() > N) {
+            map_->shrink_to_fit();
+            return;
+        }
+        for (auto &x : *map_) {
+            new (Elements() + size_) ValueType(std::move(x));
+            ++size_;
+        }
+        map_.reset();
+    }
+
+    /// Inserts elements. Returns iterator to the element with the key and whether the insertion took place.
+    std::pair<iterator, bool> insert(const ValueType &x) {
+        return try_emplace(x.first, x.second);
+    }
+
+    /// Inserts elements. Returns iterator to the element with the key and whether the insertion took place.
+    std::pair<iterator, bool> insert(ValueType &&x) {
+        if (map_ == nullptr) {
+            SizeType index = FindInline(x.first);
+            if (index != size_) {
+                return {iterator(&Element(index)), false};
+            }
+            if (size_ < N) {
+                ValueType *inserted = new (Elements() + size_) ValueType(std::move(x));
+                ++size_;
+                return {iterator(inserted), true};
+            }
+            Spill(N + 1);
+        }
+        auto [it, inserted] = map_->insert(std::move(x));
+        return {iterator(it), inserted};
+    }
+
+    /// Constructs the element from args and inserts it, if there is no element with its key. Returns iterator to the
+    /// element with the key and whether the insertion took place.
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args &&...args) {
+        if (map_ == nullptr && size_ == N) {
+            /// There is no room for the element inline, so it is constructed aside, and the elements are moved into the
+            /// map only if its key is new.
+            return insert(ValueType(std::forward<Args>(args)...));
+        }
+        if (map_ != nullptr) {
+            auto [it, inserted] = map_->emplace(std::forward<Args>(args)...);
+            return {iterator(it), inserted};
+        }
+        /// The key is known only after the construction, so the element is constructed after the last one and is
+        /// destroyed, if the key exists.
+        ValueType *x = new (Elements() + size_) ValueType(std::forward<Args>(args)...);
+        SizeType index = FindInline(x->first);
+        if (index != size_) {
+            x->~ValueType();
+            return {iterator(&Element(index)), false};
+        }
+        ++size_;
+        return {iterator(x), true};
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with the key. Otherwise
+    /// nothing is constructed. Returns iterator to the element with the key and whether the insertion took place.
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(const KeyType &key, Args &&...args) {
+        return TryEmplace(key, std::forward<Args>(args)...);
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with the key. Otherwise
+    /// nothing is constructed. Returns iterator to the element with the key and whether the insertion took place.
+    template <class... Args>
+    std::pair<iterator, bool> try_emplace(KeyType &&key, Args &&...args) {
+        return TryEmplace(std::move(key), std::forward<Args>(args)...);
+    }
+
+    /// Inserts the element constructed in place from the key and args, if there is no element with an equal key.
+    /// Key is constructed from the compatible key only when the insertion takes place.
+    template <class K, class... Args, class = EnableIfTransparent<K>>
+    std::pair<iterator, bool> try_emplace(K &&key, Args &&...args) {
+        return TryEmplace(std::forward<K>(key), std::forward<Args>(args)...);
+    }
+
+    /// Erases elements.
+    void erase(const KeyType &key) {
+        Erase(key);
+    }
+
+    /// Erases elements with a key equal to the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    void erase(const K &key) {
+        Erase(key);
+    }
+
+    /// Access specified element with bounds checking.
+    const MappedType &at(const KeyType &key) const {
+        return At(key);
+    }
+
+    /// Access specified element with bounds checking by the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    const MappedType &at(const K &key) const {
+        return At(key);
+    }
+
+    /// Access or insert specified element.
+    MappedType &operator[](const KeyType &key) {
+        return try_emplace(key).first->second;
+    }
+
+    /// Access or insert specified element.
+    MappedType &operator[](KeyType &&key) {
+        return try_emplace(std::move(key)).first->second;
+    }
+
+    /// Access or insert specified element by the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    MappedType &operator[](K &&key) {
+        return try_emplace(std::forward<K>(key)).first->second;
+    }
+
+    /// Finds element with specific key.
+    iterator find(const KeyType &key) {
+        return Find(key);
+    }
+
+    /// Finds element with specific key.
+    const_iterator find(const KeyType &key) const {
+        return Find(key);
+    }
+
+    /// Finds element with a key equal to the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    iterator find(const K &key) {
+        return Find(key);
+    }
+
+    /// Finds element with a key equal to the compatible key.
+    template <class K, class = EnableIfTransparent<K>>
+    const_iterator find(const K &key) const {
+        return Find(key);
+    }
+
+    iterator begin() {
+        return map_ != nullptr ? iterator(map_->begin()) : iterator(Elements());
+    }
+
+    iterator end() {
+        return map_ != nullptr ? iterator(map_->end()) : iterator(Elements() + size_);
+    }
+
+    const_iterator begin() const {
+        return map_ != nullptr ? const_iterator(std::as_const(*map_).begin()) : const_iterator(Elements());
+    }
+
+    const_iterator end() const {
+        return map_ != nullptr ? const_iterator(std::as_const(*map_).end()) : const_iterator(Elements() + size_);
+    }
+
+    /// Returns function used to hash the keys.
+    Hasher hash_function() const {
+        return hasher_;
+    }
+
+    /// Returns function used to compare the keys for equality.
+    KeyEqual key_eq() const {
+        return key_equal_;
+    }
+
+private:
+    /// Returns the beginning of the inline storage.
+    ValueType *Elements() {
+        return reinterpret_cast<ValueType *>(elements_);
+    }
+
+    const ValueType *Elements() const {
+        return reinterpret_cast<const ValueType *>(elements_);
+    }
+
+    /// Returns the alive inline element.
+    ValueType &Element(SizeType index) {
+        return *std::launder(Elements() + index);
+    }
+
+    const ValueType &Element(SizeType index) const {
+        return *std::launder(Elements() + index);
+    }
+
+    /// Returns index of the inline element with the key or size_, if there is none.
+    template <class K>
+    SizeType FindInline(const K &key) const {
+        SizeType index = 0;
+        while (index < size_ && !key_equal_(Element(index).first, key)) {
+            ++index;
+        }
+        return index;
+    }
+
+    /// Destroys the inline elements.
+    void DestroyInline() {
+        for (; size_ > 0; --size_) {
+            Element(size_ - 1).~ValueType();
+        }
+    }
+
+    /// Moves the elements into the new map prepared for n elements.
+    void Spill(SizeType n) {
+        auto map = std::make_unique<Map>(hasher_, key_equal_);
+        map->reserve(n);
+        for (SizeType i = 0; i < size_; ++i) {
+            map->insert(std::move(Element(i)));
+        }
+        DestroyInline();
+        map_ = std::move(map);
+    }
+
+    /// Takes the elements of the other map, that is left empty. This map has no elements.
+    void MoveFrom(SmallHashMap &other) {
+        if (other.map_ != nullptr) {
+            map_ = std::move(other.map_);
+            return;
+        }
+        for (; size_ < other.size_; ++size_) {
+            new (Elements() + size_) ValueType(std::move(other.Element(size_)));
+        }
+        other.DestroyInline();
+    }
+
+    template <class K, class... Args>
+    std::pair<iterator, bool> TryEmplace(K &&key, Args &&...args) {
+        if (map_ == nullptr) {
+            SizeType index = FindInline(key);
+            if (index != size_) {
+                return {iterator(&Element(index)), false};
+            }
+            if (size_ < N) {
+                ValueType *x = new (Elements() + size_) ValueType(std::piecewise_construct,
+                                                                  std::forward_as_tuple(std::forward<K>(key)),
+                                                                  std::forward_as_tuple(std::forward<Args>(args)...));
+                ++size_;
+                return {iterator(x), true};
+            }
+            Spill(N + 1);
+        }
+        auto [it, inserted] = map_->try_emplace(std::forward<K>(key), std::forward<Args>(args)...);
+        return {iterator(it), inserted};
+    }
+
+    /// Erases the element with a key equal to the given one.
+    template <class K>
+    void Erase(const K &key) {
+        if (map_ != nullptr) {
+            map_->erase(key);
+            return;
+        }
+        SizeType index = FindInline(key);
+        if (index == size_) {
+            return;
+        }
+        Element(index).~ValueType();
+        if (index + 1 != size_) {
+            /// Key is const, so the last element is moved into the hole by the reconstruction.
+            new (Elements() + index) ValueType(std::move(Element(size_ - 1)));
+            Element(size_ - 1).~ValueType();
+        }
+        --size_;
+    }
+
+    /// Finds the element with a key equal to the given one.
+    template <class K>
+    iterator Find(const K &key) {
+        if (map_ != nullptr) {
+            return iterator(map_->find(key));
+        }
+        return iterator(Elements() + FindInline(key));
+    }
+
+    /// Finds the element with a key equal to the given one.
+    template <class K>
+    const_iterator Find(const K &key) const {
+        if (map_ != nullptr) {
+            return const_iterator(std::as_const(*map_).find(key));
+        }
+        return const_iterator(Elements() + FindInline(key));
+    }
+
+    /// Returns the mapped value of the element with a key equal to the given one.
+    template <class K>
+    const MappedType &At(const K &key) const {
+        auto it = Find(key);
+        if (it == end()) {
+            throw std::out_of_range("_Map_base::at");
+        }
+        return it->second;
+    }
+
+    /// Private fields:
+
+    /// Storage of the inline elements, the first size_ of them are alive.
+    alignas(ValueType) unsigned char elements_[N * sizeof(ValueType)];
+    /// Number of the inline elements, zero when the map holds the elements.
+    SizeType size_ = 0;
+    /// Map of the elements after the inline storage has overflown, nullptr before.
+    std::unique_ptr<Map> map_;
+    /// Function used to hash the keys.
+    Hasher hasher_;
+    /// Function used to compare the keys for equality.
+    KeyEqual key_equal_;
+};